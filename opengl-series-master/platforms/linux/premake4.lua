@@ -49,7 +49,42 @@ solution "opengl-series"
 	create_project( "02_textures" );
 	create_project( "03_matrices" );
 	create_project( "04_camera" );
+	-- surfaceless EGL context for the overdraw evaluation on display-less nodes
+	project "04_camera-app"
+		configuration "linux"
+			defines { "HAVE_EGL" }
+			links { "EGL" }
 	create_project( "05_asset_instance" );
 	create_project( "06_diffuse_lighting" );
 	create_project( "07_more_lighting" );
 	create_project( "08_even_more_lighting" );
+
+	-- CPU stages of 04_camera, no GL
+	project "04_camera_bench"
+		kind "ConsoleApp"
+		language "C++"
+		files { "../../source/04_camera/bench/*.cpp" }
+		files { "../../source/04_camera/source/ordering.cpp", "../../source/04_camera/source/vcacheSim.cpp", "../../source/04_camera/source/dataset.cpp",
+			"../../source/04_camera/source/animationCache.cpp", "../../source/04_camera/source/textLoader.cpp", "../../source/04_camera/source/threadPool.cpp",
+			"../../source/04_camera/source/skinning.cpp", "../../source/04_camera/source/patchOrder.cpp", "../../source/04_camera/source/softRaster.cpp",
+			"../../source/04_camera/source/patchCoverage.cpp", "../../source/04_camera/source/jobLog.cpp",
+			"../../source/04_camera/source/rayEstimator.cpp",
+			"../../source/04_camera/source/occlusionGraph.cpp",
+			"../../source/04_camera/source/tdogl/Camera.cpp" }
+		targetdir("../../source/04_camera/")
+		includedirs( "../../source/common/thirdparty/glm" )
+		defines { "GLM_FORCE_RADIANS" }
+		buildoptions { "-std=c++11" }
+		links { "pthread" }
+
+		configuration "debug"
+			defines { "DEBUG" }
+			flags { "Symbols" }
+			buildoptions{ "-Wall" }
+			targetname ( "04_camera_bench-debug" )
+
+		configuration "release"
+			defines { "NDEBUG" }
+			flags { "Optimize" }
+			buildoptions{ "-Wall" }
+			targetname ( "04_camera_bench-release" )
@@ -0,0 +1,501 @@
+// benchmark of the CPU stages of the ordering pipeline, no GL context needed
+// usage: 04_camera_bench [root] [-reps N] [-warmup N] [-json path]
+// every animation found under root (see dataset.h) is run through each stage warmup + reps times
+
+#include "../source/animationCache.h"
+#include "../source/dataset.h"
+#include "../source/occlusionGraph.h"
+#include "../source/ordering.h"
+#include "../source/patchCoverage.h"
+#include "../source/rayEstimator.h"
+#include "../source/skinning.h"
+#include "../source/softRaster.h"
+#include "../source/textLoader.h"
+#include "../source/threadPool.h"
+#include "../source/vcacheSim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// VS2013's steady_clock has the resolution of the system clock, so use the performance counter there
+static long long nowNanoseconds()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (long long)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct StageResult
+{
+	const DatasetEntry *entry;
+	const char *stage;
+	int reps;
+	long long minNs;
+	long long medianNs;
+	long long meanNs;
+	long long triangles;     // triangles processed by one run, 0 if the stage does not work per triangle
+	long long scratchBytes;  // scratch handed to the stage
+	float acmr;              // FIFO ACMR of the stage output, < 0 if the stage has no index output
+	int clusters;            // clusters out of the stage, < 0 if none
+	float overdraw;          // mean overdraw of the stage orderings on frame 0, < 0 if the stage does not order
+};
+
+static StageResult timeStage(const DatasetEntry *entry, const char *stage, int warmup, int reps, long long triangles, long long scratchBytes,
+	const std::function<void()> &body)
+{
+	for (int i = 0; i < warmup; i++)
+		body();
+	std::vector<long long> times(reps);
+	for (int i = 0; i < reps; i++)
+	{
+		long long start = nowNanoseconds();
+		body();
+		times[i] = nowNanoseconds() - start;
+	}
+	std::sort(times.begin(), times.end());
+	long long sum = 0;
+	for (int i = 0; i < reps; i++)
+		sum += times[i];
+
+	StageResult result;
+	result.entry = entry;
+	result.stage = stage;
+	result.reps = reps;
+	result.minNs = times[0];
+	result.medianNs = times[reps / 2];
+	result.meanNs = sum / reps;
+	result.triangles = triangles;
+	result.scratchBytes = scratchBytes;
+	result.acmr = -1.f;
+	result.clusters = -1;
+	result.overdraw = -1.f;
+	return result;
+}
+
+// index buffer, viewpoints and all frames of one animation, from its cache or skinned
+struct BenchAnimation
+{
+	AnimationCache cache;
+	SkinnedMesh mesh;
+	int *piIndexBuffer;
+	float *pfCameraPositions;
+	float **pfFramesVertexPositions;
+};
+
+static bool loadBenchAnimation(const DatasetEntry *e, BenchAnimation *anim, ThreadPool *pool)
+{
+	memset(anim, 0, sizeof(BenchAnimation));
+	if (hasSkinnedMesh(e->vfFolder))
+	{
+		char path[400];
+		anim->piIndexBuffer = (int *)malloc((e->iNumFaces * 3 + e->numViews * 3) * sizeof(int));
+		anim->pfCameraPositions = (float *)(anim->piIndexBuffer + e->iNumFaces * 3);
+		sprintf(path, "%sface.txt", e->vfFolder);
+		bool ok = loadTextInts(path, anim->piIndexBuffer, e->iNumFaces * 3, pool);
+		sprintf(path, "%snewViewpoint3.txt", e->vfFolder);
+		ok = ok && loadTextFloats(path, anim->pfCameraPositions, e->numViews * 3, pool);
+		ok = ok && loadSkinnedMesh(e->vfFolder, e->iNumVertices, e->numFrames, &anim->mesh, pool);
+		if (ok)
+		{
+			anim->pfFramesVertexPositions = new_Array2D<float>(e->numFrames, e->iNumVertices * 3);
+			skinFrames(&anim->mesh, 0, e->numFrames, anim->pfFramesVertexPositions, pool);
+		}
+		return ok;
+	}
+	char cachePath[400];
+	sprintf(cachePath, "%s%s", e->vfFolder, ANIMCACHEFILE);
+	bool opened = openAnimationCache(cachePath, &anim->cache);
+	if (opened && animationCacheIsStale(anim->cache.pHeader, e->vfFolder))
+	{
+		closeAnimationCache(&anim->cache);
+		opened = false;
+	}
+	if (!opened)
+	{
+		if (!convertAnimationFolder(e->vfFolder, cachePath, e->iNumVertices, e->iNumFaces, e->numFrames, e->numViews, pool) || !openAnimationCache(cachePath, &anim->cache))
+			return false;
+	}
+	anim->piIndexBuffer = anim->cache.piIndexBuffer;
+	anim->pfCameraPositions = anim->cache.pfCameraPositions;
+	anim->pfFramesVertexPositions = anim->cache.pfFramesVertexPositions;
+	return true;
+}
+
+static void freeBenchAnimation(const DatasetEntry *e, BenchAnimation *anim)
+{
+	if (anim->mesh.pfBindPositions != NULL)
+	{
+		free(anim->piIndexBuffer);
+		delete_Array2D(anim->pfFramesVertexPositions, e->numFrames, e->iNumVertices * 3);
+		freeSkinnedMesh(&anim->mesh);
+	}
+	else
+	{
+		closeAnimationCache(&anim->cache);
+	}
+}
+
+static void benchAnimation(const DatasetEntry *e, int warmup, int reps, ThreadPool *pool, std::vector<StageResult> &results)
+{
+	float alpha = 0.85f; int iCacheSize = 20; int numClusters = 5;
+	int iNumFaces = e->iNumFaces, iNumVertices = e->iNumVertices, numFrames = e->numFrames, numViews = e->numViews;
+
+	BenchAnimation anim;
+	if (!loadBenchAnimation(e, &anim, pool))
+	{
+		printf("ERROR: %s cannot be loaded, skipped\n", e->vfFolder);
+		return;
+	}
+	int iScratchSize = FanVertScratchSize(iNumVertices, iNumFaces);
+	int *piScratch = (int *)malloc(iScratchSize);
+	memset(piScratch, 0, iScratchSize);
+	std::vector<int> indexLinear(iNumFaces * 3), clustersLinear(iNumFaces + 1), clustersPartition(iNumFaces + 1);
+	std::vector<int> indexOut(iNumFaces * 3), clustersOut(iNumFaces + 1);
+	int iNumLinear = 0, iNumPartition = 0, iNumPatches = 0;
+
+	// vertex cache stages
+	StageResult r = timeStage(e, "FanVertLinSort", warmup, reps, iNumFaces, iScratchSize, [&]() {
+		FanVertLinSort(anim.piIndexBuffer, &indexLinear[0], iNumFaces, piScratch, iCacheSize, &clustersLinear[0], iNumLinear);
+	});
+	VCacheStats stats;
+	simulateVCache(VCACHE_FIFO, iCacheSize, &indexLinear[0], iNumFaces, iNumVertices, &stats);
+	r.acmr = stats.acmr;
+	r.clusters = iNumLinear;
+	results.push_back(r);
+
+	r = timeStage(e, "OverdrawOrderPartition", warmup, reps, iNumFaces, VCacheSimScratchSize(VCACHE_FIFO, iNumVertices) * sizeof(int), [&]() {
+		iNumPartition = OverdrawOrderPartition(&indexLinear[0], iNumFaces, iNumVertices, &clustersLinear[0], iNumLinear, iCacheSize, alpha, &clustersPartition[0], piScratch);
+	});
+	// the partition only cuts the patches, the index buffer is FanVertLinSort's
+	r.clusters = iNumPartition;
+	results.push_back(r);
+
+	r = timeStage(e, "FanVertCluster", warmup, reps, iNumFaces, iScratchSize, [&]() {
+		FanVertCluster(anim.pfFramesVertexPositions[0], anim.piIndexBuffer, &indexOut[0], iNumVertices, iNumFaces, iCacheSize, alpha, piScratch, &clustersOut[0], &iNumPatches);
+	});
+	simulateVCache(VCACHE_FIFO, iCacheSize, &indexOut[0], iNumFaces, iNumVertices, &stats);
+	r.acmr = stats.acmr;
+	r.clusters = iNumPatches;
+	results.push_back(r);
+
+	// patch positions of every frame
+	Vector **pvFramesPatchesPositions = new_Array2D<Vector>(numFrames, iNumPatches);
+	r = timeStage(e, "pvPatchesPostions", warmup, reps, (long long)iNumFaces * numFrames, iNumPatches * 7 * sizeof(int), [&]() {
+		for (int i = 0; i < numFrames; i++)
+			pvPatchesPostions(&indexOut[0], iNumFaces, anim.pfFramesVertexPositions[i], iNumVertices, &clustersOut[0], iNumPatches, pvFramesPatchesPositions[i], piScratch);
+	});
+	r.clusters = iNumPatches;
+	results.push_back(r);
+
+	// one ordering per view of the average patch positions
+	std::vector<Vector> avgPatchesPositions(iNumPatches, Vector(0, 0, 0));
+	for (int i = 0; i < numFrames; i++)
+		for (int j = 0; j < iNumPatches; j++)
+			avgPatchesPositions[j] += pvFramesPatchesPositions[i][j];
+	for (int j = 0; j < iNumPatches; j++)
+		avgPatchesPositions[j] /= numFrames;
+	std::vector<PatchId> order(iNumPatches);
+	Vector *pvCameraPositions = (Vector *)anim.pfCameraPositions;
+	r = timeStage(e, "depthSortPatch", warmup, reps, (long long)iNumFaces * numViews, iNumPatches * 2 * sizeof(int), [&]() {
+		for (int v = 0; v < numViews; v++)
+			depthSortPatch(pvCameraPositions[v], &avgPatchesPositions[0], iNumPatches, &order[0]);
+	});
+	r.clusters = iNumPatches;
+	results.push_back(r);
+
+	// software overdraw of frame 0 in FanVertCluster order, every view on a 50 x 50 canvas as in the app
+	int iCanvasSize = 50;
+	std::vector<float> viewMatrices(numViews * 16);
+	std::vector<OverdrawStats> overdraw(numViews);
+	buildViewMatrices(anim.pfCameraPositions, numViews, 1.f, &viewMatrices[0]);
+	r = timeStage(e, "softRaster", warmup, reps, (long long)iNumFaces * numViews, (numViews * 16 + iCanvasSize * iCanvasSize * 2) * sizeof(float), [&]() {
+		softwareOverdraw(anim.pfFramesVertexPositions[0], iNumVertices, &indexOut[0], iNumFaces, &viewMatrices[0], numViews, iCanvasSize, iCanvasSize, &overdraw[0], pool);
+	});
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += overdraw[v].ratio / numViews;
+	results.push_back(r);
+
+	// the same views through the patch coverage cache: built once, then every view scores the distance order
+	// of every view, numViews x numViews orderings; the overdraw is the one of each view's own order
+	CoverageCache coverage;
+	r = timeStage(e, "coverageBuild", warmup, reps, (long long)iNumFaces * numViews, 0, [&]() {
+		buildCoverageCache(anim.pfFramesVertexPositions, 1, iNumVertices, &indexOut[0], &clustersOut[0], iNumPatches, iNumFaces,
+			anim.pfCameraPositions, numViews, iCanvasSize, iCanvasSize, &coverage, pool);
+	});
+	r.scratchBytes = coverageCacheSize(&coverage);
+	r.clusters = iNumPatches;
+	results.push_back(r);
+	PatchId **viewOrders = new_Array2D<PatchId>(numViews, iNumPatches);
+	for (int v = 0; v < numViews; v++)
+		depthSortPatch(pvCameraPositions[v], pvFramesPatchesPositions[0], iNumPatches, viewOrders[v]);
+	std::vector<float> coverageDepth(iCanvasSize * iCanvasSize);
+	r = timeStage(e, "coverageEval", warmup, reps, (long long)iNumFaces * numViews * numViews, coverageDepth.size() * sizeof(float), [&]() {
+		for (int o = 0; o < numViews; o++)
+			for (int v = 0; v < numViews; v++)
+				patchOrderRatio(coverageAt(&coverage, 0, v), viewOrders[o], &coverageDepth[0]);
+	});
+	r.clusters = iNumPatches;
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += patchOrderRatio(coverageAt(&coverage, 0, v), viewOrders[v], &coverageDepth[0]) / numViews;
+	results.push_back(r);
+
+	// occlusion graphs of the same views, then one feedback arc set ordering per view (distance order for ties)
+	OcclusionGraphCache graphs;
+	r = timeStage(e, "occlusionGraph", warmup, reps, 0, 0, [&]() {
+		buildOcclusionGraphCache(&coverage, &graphs, pool);
+	});
+	r.scratchBytes = occlusionGraphCacheSize(&graphs);
+	results.push_back(r);
+	PatchId **occlusionOrders = new_Array2D<PatchId>(numViews, iNumPatches);
+	r = timeStage(e, "occlusionOrder", warmup, reps, 0, iNumPatches * 12 * sizeof(int), [&]() {
+		for (int v = 0; v < numViews; v++)
+		{
+			clusterAssign member;
+			member.frameId = 0;
+			member.viewId = v;
+			occlusionOrder(&graphs, &member, 1, viewOrders[v], occlusionOrders[v]);
+		}
+	});
+	r.clusters = iNumPatches;
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += patchOrderRatio(coverageAt(&coverage, 0, v), occlusionOrders[v], &coverageDepth[0]) / numViews;
+	results.push_back(r);
+	delete_Array2D(occlusionOrders, numViews, iNumPatches);
+
+	// sampled estimate of the same views: BVH and rays, then the distance order of each view scored on its view
+	int numRays = 256;
+	CoverageCache rays;
+	r = timeStage(e, "rayTrace", warmup, reps, 0, 0, [&]() {
+		buildRayCache(anim.pfFramesVertexPositions, 1, &indexOut[0], &clustersOut[0], iNumPatches, iNumFaces, anim.pfCameraPositions,
+			numViews, 1.f, numRays, &rays, pool);
+	});
+	r.scratchBytes = coverageCacheSize(&rays);
+	results.push_back(r);
+	std::vector<float> rayDepth(numRays);
+	std::vector<int> rayDrawn(numRays);
+	RayEstimate estimate;
+	r = timeStage(e, "rayEval", warmup, reps, 0, numRays * (sizeof(float) + sizeof(int)), [&]() {
+		for (int v = 0; v < numViews; v++)
+			estimateOverdraw(coverageAt(&rays, 0, v), viewOrders[v], &estimate, &rayDepth[0], &rayDrawn[0]);
+	});
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+	{
+		estimateOverdraw(coverageAt(&rays, 0, v), viewOrders[v], &estimate, &rayDepth[0], &rayDrawn[0]);
+		r.overdraw += estimate.ratio / numViews;
+	}
+	results.push_back(r);
+	delete_Array2D(viewOrders, numViews, iNumPatches);
+
+	// clustering: seed views and initial means, then Lloyd iterations over the views of frame 0 scored on the coverage cache
+	std::vector<int> pickIds(numClusters);
+	PatchId **means = new_Array2D<PatchId>(numClusters, iNumPatches);
+	int **assignments = new_Array2D<int>(1, numViews);
+	float **minRatios = new_Array2D<float>(1, numViews);
+	OrderingEvaluator evaluate = [&](const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios) {
+		coverageRatios(&coverage, pusPatchOrder, members, numMembers, pfRatios, pool);
+	};
+	long long clusterScratch = (numViews * 3 + iNumPatches * 3) * sizeof(int) * numClusters + numViews * numClusters * sizeof(float)
+		+ numViews * iNumPatches * sizeof(PatchId);
+	std::ostringstream quiet;
+	std::streambuf *coutBuffer = std::cout.rdbuf(quiet.rdbuf());  // clusterMeans reports every iteration
+	r = timeStage(e, "clustering", warmup, reps, 0, clusterScratch, [&]() {
+		seedViews(pvFramesPatchesPositions, 1, iNumPatches, anim.pfCameraPositions, numViews, numClusters, numClusters, 1, &pickIds[0], pool);
+		initMeans(means, pvFramesPatchesPositions, 1, numClusters, iNumPatches, &pickIds[0], anim.pfCameraPositions, piScratch);
+		clusterMeans(means, numClusters, iNumPatches, pvFramesPatchesPositions, pvCameraPositions, 1, numViews, evaluate, 50, 600.0,
+			assignments, minRatios, pool);
+		quiet.str("");
+	});
+	std::cout.rdbuf(coutBuffer);
+	r.clusters = numClusters;
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += minRatios[0][v] / numViews;
+	results.push_back(r);
+
+	// the same from the same seeds with mini-batches of the views
+	coutBuffer = std::cout.rdbuf(quiet.rdbuf());
+	r = timeStage(e, "miniBatch", warmup, reps, 0, clusterScratch, [&]() {
+		seedViews(pvFramesPatchesPositions, 1, iNumPatches, anim.pfCameraPositions, numViews, numClusters, numClusters, 1, &pickIds[0], pool);
+		initMeans(means, pvFramesPatchesPositions, 1, numClusters, iNumPatches, &pickIds[0], anim.pfCameraPositions, piScratch);
+		clusterMeansMiniBatch(means, numClusters, iNumPatches, pvFramesPatchesPositions, pvCameraPositions, 1, numViews, evaluate, 64, numViews, 1.5f,
+			50, 600.0, 1, assignments, minRatios, pool);
+		quiet.str("");
+	});
+	std::cout.rdbuf(coutBuffer);
+	r.clusters = numClusters;
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += minRatios[0][v] / numViews;
+	results.push_back(r);
+
+	// assignment step alone on the full frames x views x clusters tensor, frame 0's ratios of the final means repeated
+	std::vector<float> meanRatios((size_t)numViews * numClusters);
+	std::vector<clusterAssign> views(numViews);
+	for (int v = 0; v < numViews; v++)
+	{
+		views[v].frameId = 0;
+		views[v].viewId = v;
+	}
+	std::vector<float> ratios(numViews);
+	for (int c = 0; c < numClusters; c++)
+	{
+		evaluate(means[c], &views[0], numViews, &ratios[0]);
+		for (int v = 0; v < numViews; v++)
+			meanRatios[(size_t)v * numClusters + c] = ratios[v];
+	}
+	std::vector<float> tensor((size_t)numFrames * meanRatios.size());
+	for (int f = 0; f < numFrames; f++)
+		std::copy(meanRatios.begin(), meanRatios.end(), tensor.begin() + (size_t)f * meanRatios.size());
+	int **frameAssignments = new_Array2D<int>(numFrames, numViews);
+	float **frameMinRatios = new_Array2D<float>(numFrames, numViews);
+	r = timeStage(e, "assignment", warmup, reps, 0, tensor.size() * sizeof(float), [&]() {
+		makeAssignment(&tensor[0], frameAssignments, frameMinRatios, numFrames, numViews, numClusters, pool);
+	});
+	r.clusters = numClusters;
+	r.overdraw = 0.f;
+	for (int v = 0; v < numViews; v++)
+		r.overdraw += frameMinRatios[0][v] / numViews;
+	results.push_back(r);
+	delete_Array2D(frameMinRatios, numFrames, numViews);
+	delete_Array2D(frameAssignments, numFrames, numViews);
+
+	delete_Array2D(minRatios, 1, numViews);
+	delete_Array2D(assignments, 1, numViews);
+	delete_Array2D(means, numClusters, iNumPatches);
+	delete_Array2D(pvFramesPatchesPositions, numFrames, iNumPatches);
+	free(piScratch);
+	freeBenchAnimation(e, &anim);
+}
+
+static void printTable(const std::vector<StageResult> &results)
+{
+	printf("%-20s %-28s %-24s %12s %12s %14s %10s %6s %8s %8s\n", "character", "animation", "stage", "min ns", "median ns", "triangles/s", "scratch", "acmr", "clusters", "overdraw");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const StageResult &r = results[i];
+		double trianglesPerSecond = r.minNs > 0 ? r.triangles * 1e9 / r.minNs : 0.0;
+		printf("%-20s %-28s %-24s %12lld %12lld", r.entry->character, r.entry->animation, r.stage, r.minNs, r.medianNs);
+		if (r.triangles > 0)
+			printf(" %14.4g", trianglesPerSecond);
+		else
+			printf(" %14s", "-");
+		printf(" %10lld", r.scratchBytes);
+		if (r.acmr >= 0.f)
+			printf(" %6.3f", r.acmr);
+		else
+			printf(" %6s", "-");
+		if (r.clusters >= 0)
+			printf(" %8d", r.clusters);
+		else
+			printf(" %8s", "-");
+		if (r.overdraw >= 0.f)
+			printf(" %8.4f\n", r.overdraw);
+		else
+			printf(" %8s\n", "-");
+	}
+}
+
+static bool writeJson(const char *path, const std::vector<StageResult> &results)
+{
+	FILE * myFile = fopen(path, "w");
+	if (myFile == NULL)
+	{
+		printf("ERROR: File cannot be created %s\n", path);
+		return false;
+	}
+	fprintf(myFile, "[\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const StageResult &r = results[i];
+		double trianglesPerSecond = r.minNs > 0 ? r.triangles * 1e9 / r.minNs : 0.0;
+		fprintf(myFile, "  {\"character\": \"%s\", \"animation\": \"%s\", \"stage\": \"%s\", \"vertices\": %d, \"faces\": %d, \"frames\": %d, \"views\": %d, "
+			"\"reps\": %d, \"minNs\": %lld, \"medianNs\": %lld, \"meanNs\": %lld, \"scratchBytes\": %lld, ",
+			r.entry->character, r.entry->animation, r.stage, r.entry->iNumVertices, r.entry->iNumFaces, r.entry->numFrames, r.entry->numViews,
+			r.reps, r.minNs, r.medianNs, r.meanNs, r.scratchBytes);
+		if (r.triangles > 0)
+			fprintf(myFile, "\"trianglesPerSec\": %.6g, ", trianglesPerSecond);
+		else
+			fprintf(myFile, "\"trianglesPerSec\": null, ");
+		if (r.acmr >= 0.f)
+			fprintf(myFile, "\"acmr\": %.6g, ", r.acmr);
+		else
+			fprintf(myFile, "\"acmr\": null, ");
+		if (r.clusters >= 0)
+			fprintf(myFile, "\"clusters\": %d, ", r.clusters);
+		else
+			fprintf(myFile, "\"clusters\": null, ");
+		if (r.overdraw >= 0.f)
+			fprintf(myFile, "\"overdraw\": %.6g}", r.overdraw);
+		else
+			fprintf(myFile, "\"overdraw\": null}");
+		fprintf(myFile, i + 1 < results.size() ? ",\n" : "\n");
+	}
+	fprintf(myFile, "]\n");
+	return fclose(myFile) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char root[300];
+	strcpy(root, "VerticeFace/");
+	int warmup = 1, reps = 5;
+	const char *jsonPath = "bench.json";
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc)
+			reps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc)
+			warmup = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (strlen(argv[i]) < sizeof(root) - 1)
+		{
+			strcpy(root, argv[i]);
+			size_t len = strlen(root);
+			if (root[len - 1] != '/' && root[len - 1] != '\\')
+				strcat(root, "/");
+		}
+	}
+	if (reps < 1)
+		reps = 1;
+	if (warmup < 0)
+		warmup = 0;
+
+	std::vector<DatasetEntry> entries;
+	if (!discoverDataset(root, entries))
+		return EXIT_FAILURE;
+	ThreadPool pool;
+	std::vector<StageResult> results;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		std::cout << entries[i].character << "/" << entries[i].animation << std::endl;
+		benchAnimation(&entries[i], warmup, reps, &pool, results);
+	}
+	printTable(results);
+	if (!writeJson(jsonPath, results))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
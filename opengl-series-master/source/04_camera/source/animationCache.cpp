@@ -0,0 +1,232 @@
+#include "animationCache.h"
+#include "jobLog.h"
+#include "textLoader.h"
+#include "threadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static long long alignUp(long long iOffset)
+{
+	return (iOffset + ANIMCACHEALIGN - 1) / ANIMCACHEALIGN * ANIMCACHEALIGN;
+}
+
+static bool writePadding(FILE *myFile, long long iOffset)
+{
+	static const char zeros[ANIMCACHEALIGN] = { 0 };
+	long long iPad = alignUp(iOffset) - iOffset;
+	return iPad == 0 || fwrite(zeros, 1, (size_t)iPad, myFile) == (size_t)iPad;
+}
+
+// size and modification time of one file, false if it does not exist
+static bool fileStamp(const char *path, long long *piBytes, long long *piTime)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+		return false;
+	*piBytes = ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	*piTime = ((long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+	*piBytes = (long long)st.st_size;
+	*piTime = (long long)st.st_mtime;
+#endif
+	return true;
+}
+
+bool animationSourceSignature(const char *vfFolder, long long *piSourceBytes, long long *piSourceTime)
+{
+	char path[400];
+	long long iBytes, iTime;
+	*piSourceBytes = 0;
+	*piSourceTime = 0;
+	sprintf(path, "%sface.txt", vfFolder);
+	if (!fileStamp(path, &iBytes, &iTime))
+		return false;
+	*piSourceBytes += iBytes;
+	*piSourceTime = iTime;
+	sprintf(path, "%snewViewpoint3.txt", vfFolder);
+	for (int frameId = 1; fileStamp(path, &iBytes, &iTime); frameId++)
+	{
+		*piSourceBytes += iBytes;
+		if (iTime > *piSourceTime)
+			*piSourceTime = iTime;
+		sprintf(path, "%sframe%dv.txt", vfFolder, frameId);
+	}
+	return true;
+}
+
+bool animationCacheIsStale(const AnimationCacheHeader *pHeader, const char *vfFolder)
+{
+	long long iSourceBytes, iSourceTime;
+	if (!animationSourceSignature(vfFolder, &iSourceBytes, &iSourceTime))
+		return false;
+	return iSourceBytes != pHeader->iSourceBytes || iSourceTime != pHeader->iSourceTime;
+}
+
+bool convertAnimationFolder(const char *vfFolder, const char *cachePath, int iNumVertices, int iNumFaces, int numFrames, int numViews, ThreadPool *pool)
+{
+	AnimationCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ANIMCACHEMAGIC;
+	header.version = ANIMCACHEVERSION;
+	header.iNumVertices = iNumVertices;
+	header.iNumFaces = iNumFaces;
+	header.numFrames = numFrames;
+	header.numViews = numViews;
+	header.iFrameStride = (int)(alignUp(iNumVertices * 3 * (long long)sizeof(float)) / sizeof(float));
+	header.iFacesOffset = alignUp(sizeof(AnimationCacheHeader));
+	header.iViewsOffset = alignUp(header.iFacesOffset + iNumFaces * 3 * (long long)sizeof(int));
+	header.iFramesOffset = alignUp(header.iViewsOffset + numViews * 3 * (long long)sizeof(float));
+	header.iFileSize = header.iFramesOffset + numFrames * (long long)header.iFrameStride * sizeof(float);
+	animationSourceSignature(vfFolder, &header.iSourceBytes, &header.iSourceTime);
+
+	// frames are parsed in batches of a few per pool thread and written in order
+	int numBatchFrames = (pool != NULL ? pool->size() : 1) * 4;
+	if (numBatchFrames > numFrames)
+		numBatchFrames = numFrames;
+	int iScratchSize = (iNumFaces * 3 + numViews * 3 + numBatchFrames * header.iFrameStride) * sizeof(int);
+	int *piScratch = (int *)malloc(iScratchSize);
+	memset(piScratch, 0, iScratchSize);
+	int *piIndexBuffer = piScratch;
+	float *pfCameraPositions = (float *)(piIndexBuffer + iNumFaces * 3);
+	std::vector<float *> pfBatchVertexPositions(numBatchFrames + 1);
+	for (int i = 0; i < numBatchFrames; i++)
+		pfBatchVertexPositions[i] = pfCameraPositions + numViews * 3 + i * header.iFrameStride;
+
+	char path[300];
+	bool ok = true;
+	strcpy(path, vfFolder);
+	strcat(path, "face.txt");
+	ok = ok && loadTextInts(path, piIndexBuffer, iNumFaces * 3, pool);
+	strcpy(path, vfFolder);
+	strcat(path, "newViewpoint3.txt");
+	ok = ok && loadTextFloats(path, pfCameraPositions, numViews * 3, pool);
+
+	FILE * cacheFile = ok ? fopen(cachePath, "wb") : NULL;
+	if (ok && cacheFile == NULL)
+	{
+		jobPrintf("ERROR: Cache file cannot be created %s\n", cachePath);
+		ok = false;
+	}
+	if (ok)
+	{
+		ok = fwrite(&header, sizeof(header), 1, cacheFile) == 1
+			&& writePadding(cacheFile, sizeof(header))
+			&& fwrite(piIndexBuffer, sizeof(int), iNumFaces * 3, cacheFile) == (size_t)(iNumFaces * 3)
+			&& writePadding(cacheFile, header.iFacesOffset + iNumFaces * 3 * (long long)sizeof(int))
+			&& fwrite(pfCameraPositions, sizeof(float), numViews * 3, cacheFile) == (size_t)(numViews * 3)
+			&& writePadding(cacheFile, header.iViewsOffset + numViews * 3 * (long long)sizeof(float));
+	}
+	for (int frameId = 0; ok && frameId < numFrames; frameId += numBatchFrames)
+	{
+		int numLoad = numFrames - frameId < numBatchFrames ? numFrames - frameId : numBatchFrames;
+		ok = loadTextFrames(vfFolder, frameId, numLoad, &pfBatchVertexPositions[0], iNumVertices, pool);
+		for (int i = 0; ok && i < numLoad; i++)
+		{
+			ok = fwrite(pfBatchVertexPositions[i], sizeof(float), header.iFrameStride, cacheFile) == (size_t)header.iFrameStride;
+		}
+	}
+
+	if (cacheFile != NULL)
+	{
+		ok = (fclose(cacheFile) == 0) && ok;
+		if (!ok)
+			remove(cachePath);
+	}
+	free(piScratch);
+	if (ok)
+		std::cout << "wrote animation cache " << cachePath << std::endl;
+	return ok;
+}
+
+bool openAnimationCache(const char *cachePath, AnimationCache *cache)
+{
+	memset(cache, 0, sizeof(AnimationCache));
+	char *pBase = NULL;
+	size_t iSize = 0;
+#if defined(_WIN32)
+	HANDLE hFile = CreateFileA(cachePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(hFile, &fileSize);
+	iSize = (size_t)fileSize.QuadPart;
+	HANDLE hMapping = iSize >= sizeof(AnimationCacheHeader) ? CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+	if (hMapping != NULL)
+		pBase = (char *)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+	cache->hFile = hFile;
+	cache->hMapping = hMapping;
+#else
+	int fd = open(cachePath, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(AnimationCacheHeader))
+	{
+		iSize = (size_t)st.st_size;
+		void *p = mmap(NULL, iSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+			pBase = (char *)p;
+	}
+	close(fd);
+#endif
+	cache->pMapping = pBase;
+	cache->iMappingSize = iSize;
+	if (pBase == NULL)
+	{
+		closeAnimationCache(cache);
+		return false;
+	}
+
+	AnimationCacheHeader *pHeader = (AnimationCacheHeader *)pBase;
+	if (pHeader->magic != ANIMCACHEMAGIC || pHeader->version != ANIMCACHEVERSION || pHeader->iFileSize != (long long)iSize)
+	{
+		jobPrintf("ERROR: %s is not a valid animation cache\n", cachePath);
+		closeAnimationCache(cache);
+		return false;
+	}
+	cache->pHeader = pHeader;
+	cache->piIndexBuffer = (int *)(pBase + pHeader->iFacesOffset);
+	cache->pfCameraPositions = (float *)(pBase + pHeader->iViewsOffset);
+	cache->pfFramesVertexPositions = (float **)malloc(pHeader->numFrames * sizeof(float *));
+	for (int i = 0; i < pHeader->numFrames; i++)
+	{
+		cache->pfFramesVertexPositions[i] = (float *)(pBase + pHeader->iFramesOffset) + i * (long long)pHeader->iFrameStride;
+	}
+	return true;
+}
+
+void closeAnimationCache(AnimationCache *cache)
+{
+	free(cache->pfFramesVertexPositions);
+#if defined(_WIN32)
+	if (cache->pMapping != NULL)
+		UnmapViewOfFile(cache->pMapping);
+	if (cache->hMapping != NULL)
+		CloseHandle((HANDLE)cache->hMapping);
+	if (cache->hFile != NULL && cache->hFile != INVALID_HANDLE_VALUE)
+		CloseHandle((HANDLE)cache->hFile);
+#else
+	if (cache->pMapping != NULL)
+		munmap(cache->pMapping, cache->iMappingSize);
+#endif
+	memset(cache, 0, sizeof(AnimationCache));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+// binary cache of one character/animation folder under VerticeFace/
+// layout: header | face indices | camera positions | frame 0 vertices | frame 1 vertices | ...
+// every section starts on an ANIMCACHEALIGN byte boundary so the arrays can be used in place
+#define ANIMCACHEMAGIC 0x43414656 // "VFAC"
+#define ANIMCACHEVERSION 2
+#define ANIMCACHEALIGN 64
+#define ANIMCACHEFILE "animation.vfc"
+
+class ThreadPool;
+
+struct AnimationCacheHeader
+{
+	int magic;
+	int version;
+	int iNumVertices;
+	int iNumFaces;
+	int numFrames;
+	int numViews;
+	int iFrameStride;           // floats between two consecutive frames (iNumVertices*3 rounded up to the alignment)
+	int reserved;
+	long long iFacesOffset;     // byte offsets of the sections from the start of the file
+	long long iViewsOffset;
+	long long iFramesOffset;
+	long long iFileSize;
+	long long iSourceBytes;     // signature of the text files the cache was converted from, see animationSourceSignature
+	long long iSourceTime;
+};
+
+// a mapped cache file; all pointers point straight into the mapping
+struct AnimationCache
+{
+	AnimationCacheHeader * pHeader;
+	int * piIndexBuffer;               // iNumFaces*3 ints
+	float * pfCameraPositions;         // numViews*3 floats
+	float ** pfFramesVertexPositions;  // numFrames row pointers, iNumVertices*3 floats each
+	void * pMapping;
+	size_t iMappingSize;
+	void * hFile;                      // platform handles, only used by closeAnimationCache
+	void * hMapping;
+};
+
+// one-time converter: reads face.txt, newViewpoint3.txt and frame<N>v.txt from vfFolder and writes them to cachePath;
+// the text files are parsed on pool (may be NULL)
+bool convertAnimationFolder(const char *vfFolder, const char *cachePath, int iNumVertices, int iNumFaces, int numFrames, int numViews, ThreadPool *pool);
+
+// total size and latest modification time of face.txt, newViewpoint3.txt and the consecutive frame<N>v.txt files
+// of vfFolder; false if face.txt is missing (a folder that only has the cache)
+bool animationSourceSignature(const char *vfFolder, long long *piSourceBytes, long long *piSourceTime);
+
+// the text files of vfFolder changed since the cache of pHeader was converted; a cache without its text is not stale
+bool animationCacheIsStale(const AnimationCacheHeader *pHeader, const char *vfFolder);
+
+// maps cachePath copy-on-write; the arrays can be written to without touching the file
+bool openAnimationCache(const char *cachePath, AnimationCache *cache);
+void closeAnimationCache(AnimationCache *cache);
@@ -0,0 +1,85 @@
+#include "batch.h"
+#include "jobLog.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+long long estimateJobCost(const DatasetEntry *entry)
+{
+	return (long long)entry->numFrames * entry->numViews * entry->iNumFaces;
+}
+
+static bool largerCost(const BatchJob &a, const BatchJob &b)
+{
+	return a.cost > b.cost;
+}
+
+std::vector<BatchJob> runBatch(const std::vector<DatasetEntry> &entries, ThreadPool *pool, int maxJobsInFlight,
+	const std::function<bool(const DatasetEntry *)> &job)
+{
+	std::vector<BatchJob> jobs(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		jobs[i].entry = entries[i];
+		jobs[i].cost = estimateJobCost(&entries[i]);
+		jobs[i].seconds = 0.0;
+		jobs[i].ok = false;
+	}
+	std::stable_sort(jobs.begin(), jobs.end(), largerCost);
+
+	// one task per job slot, the slots take the jobs in order from one shared counter, which gives the largest
+	// first schedule with no more than numSlots jobs at a time
+	int numSlots = std::max(1, std::min(maxJobsInFlight, (int)jobs.size()));
+	std::atomic<int> nextJob(0);
+	parallelFor(pool, 0, numSlots, [&](int slot) {
+		for (int i = nextJob++; i < (int)jobs.size(); i = nextJob++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			beginJobLog();
+			jobs[i].ok = job(&jobs[i].entry);
+			jobs[i].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			printJobLog(endJobLog());
+		}
+	});
+	return jobs;
+}
+
+static void printSummary(FILE *out, const std::vector<BatchJob> &jobs, double wallSeconds)
+{
+	int numFailed = 0;
+	long long numFrames = 0;
+	double jobSeconds = 0.0;
+	fprintf(out, "%-24s %-32s %8s %8s %10s %12s %s\n", "character", "animation", "frames", "seconds", "frames/s", "viewframes/s", "status");
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		const DatasetEntry &e = jobs[i].entry;
+		double seconds = jobs[i].seconds > 1e-9 ? jobs[i].seconds : 1e-9;
+		fprintf(out, "%-24s %-32s %8d %8.2f %10.1f %12.1f %s\n", e.character, e.animation, e.numFrames, jobs[i].seconds,
+			e.numFrames / seconds, (double)e.numFrames * e.numViews / seconds, jobs[i].ok ? "ok" : "FAILED");
+		if (!jobs[i].ok)
+			numFailed++;
+		numFrames += e.numFrames;
+		jobSeconds += jobs[i].seconds;
+	}
+	double wall = wallSeconds > 1e-9 ? wallSeconds : 1e-9;
+	fprintf(out, "%d jobs (%d failed), %lld frames in %.2f s wall, %.1f frames/s, %.2f jobs in flight on average\n",
+		(int)jobs.size(), numFailed, numFrames, wallSeconds, numFrames / wall, jobSeconds / wall);
+}
+
+void printBatchSummary(const std::vector<BatchJob> &jobs, double wallSeconds, const char *path)
+{
+	printSummary(stdout, jobs, wallSeconds);
+	if (path == NULL)
+		return;
+	FILE * myFile = fopen(path, "w");
+	if (myFile == NULL)
+	{
+		printf("ERROR: File cannot be created %s\n", path);
+		return;
+	}
+	printSummary(myFile, jobs, wallSeconds);
+	fclose(myFile);
+}
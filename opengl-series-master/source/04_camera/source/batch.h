@@ -0,0 +1,32 @@
+#pragma once
+
+#include "dataset.h"
+
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+// one (character, animation) pair of a batch run
+struct BatchJob
+{
+	DatasetEntry entry;
+	long long cost;     // estimated work, jobs start largest first
+	double seconds;     // wall time of the job
+	bool ok;
+};
+
+// estimated work of one animation: the clustering sorts every patch for every view of every frame,
+// and the patch count follows the face count
+long long estimateJobCost(const DatasetEntry *entry);
+
+// runs job on every entry, at most maxJobsInFlight at a time on pool (every job holds a whole animation and its
+// caches, so memory grows with the jobs in flight); jobs are ordered largest first and a job slot takes the next
+// one as soon as it is free, so one long animation does not leave the other slots idle at the end. job may itself
+// use the pool, the threads not running a job help it. The output of every job is buffered (see jobLog.h) and
+// printed when the job ends. Returns the jobs in run order.
+std::vector<BatchJob> runBatch(const std::vector<DatasetEntry> &entries, ThreadPool *pool, int maxJobsInFlight,
+	const std::function<bool(const DatasetEntry *)> &job);
+
+// per job wall time and throughput, to stdout and to path (if not NULL)
+void printBatchSummary(const std::vector<BatchJob> &jobs, double wallSeconds, const char *path);
@@ -0,0 +1,197 @@
+#include "dataset.h"
+#include "animationCache.h"
+#include "skinning.h"
+#include "textLoader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// names of the sub folders of path, sorted
+static std::vector<std::string> listFolders(const char *path)
+{
+	std::vector<std::string> folders;
+#if defined(_WIN32)
+	std::string pattern = std::string(path) + "*";
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = FindFirstFileA(pattern.c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return folders;
+	do
+	{
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && findData.cFileName[0] != '.')
+			folders.push_back(findData.cFileName);
+	} while (FindNextFileA(hFind, &findData));
+	FindClose(hFind);
+#else
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return folders;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (ent->d_name[0] == '.')
+			continue;
+		std::string full = std::string(path) + ent->d_name;
+		struct stat st;
+		if (stat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+			folders.push_back(ent->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(folders.begin(), folders.end());
+	return folders;
+}
+
+static bool fileExists(const char *path)
+{
+	FILE * myFile = fopen(path, "rb");
+	if (myFile == NULL)
+		return false;
+	fclose(myFile);
+	return true;
+}
+
+// number of consecutive files <vfFolder><prefix>1<suffix>, <prefix>2<suffix>, ...
+static int countNumberedFiles(const char *vfFolder, const char *prefix, const char *suffix)
+{
+	char path[400];
+	int n = 0;
+	for (;;)
+	{
+		sprintf(path, "%s%s%d%s", vfFolder, prefix, n + 1, suffix);
+		if (!fileExists(path))
+			return n;
+		n++;
+	}
+}
+
+// value count of <vfFolder><name> divided by stride, -1 if the file is missing or the count is not a multiple
+static int countTextRecords(const char *vfFolder, const char *name, int stride)
+{
+	char path[400];
+	sprintf(path, "%s%s", vfFolder, name);
+	int count = countTextValues(path);
+	if (count <= 0 || count % stride != 0)
+		return -1;
+	return count / stride;
+}
+
+bool inspectAnimationFolder(const char *root, const char *character, const char *animation, DatasetEntry *entry)
+{
+	memset(entry, 0, sizeof(DatasetEntry));
+	if (strlen(character) >= sizeof(entry->character) || strlen(animation) >= sizeof(entry->animation)
+		|| strlen(root) + strlen(character) + strlen(animation) + 3 > sizeof(entry->vfFolder))
+	{
+		printf("ERROR: dataset path too long %s%s/%s\n", root, character, animation);
+		return false;
+	}
+	strcpy(entry->character, character);
+	strcpy(entry->animation, animation);
+	sprintf(entry->vfFolder, "%s%s/%s/", root, character, animation);
+
+	// a valid cache already knows its counts, unless the text files changed since it was written
+	char path[400];
+	sprintf(path, "%s%s", entry->vfFolder, ANIMCACHEFILE);
+	FILE * cacheFile = fopen(path, "rb");
+	if (cacheFile != NULL)
+	{
+		AnimationCacheHeader header;
+		bool ok = fread(&header, sizeof(header), 1, cacheFile) == 1 && header.magic == ANIMCACHEMAGIC && header.version == ANIMCACHEVERSION;
+		fclose(cacheFile);
+		if (ok && animationCacheIsStale(&header, entry->vfFolder))
+		{
+			printf("%s is older than the text files, it is rebuilt\n", path);
+			ok = false;
+		}
+		if (ok)
+		{
+			entry->iNumVertices = header.iNumVertices;
+			entry->iNumFaces = header.iNumFaces;
+			entry->numFrames = header.numFrames;
+			entry->numViews = header.numViews;
+			return true;
+		}
+	}
+
+	entry->iNumFaces = countTextRecords(entry->vfFolder, "face.txt", 3);
+	entry->numViews = countTextRecords(entry->vfFolder, "newViewpoint3.txt", 3);
+	if (hasSkinnedMesh(entry->vfFolder))
+	{
+		entry->iNumVertices = countTextRecords(entry->vfFolder, "bindpose.txt", 3);
+		entry->numFrames = countNumberedFiles(entry->vfFolder, "joints", ".txt");
+	}
+	else
+	{
+		entry->iNumVertices = countTextRecords(entry->vfFolder, "frame1v.txt", 3);
+		entry->numFrames = countNumberedFiles(entry->vfFolder, "frame", "v.txt");
+	}
+	if (entry->iNumFaces <= 0 || entry->numViews <= 0 || entry->iNumVertices <= 0 || entry->numFrames <= 0)
+	{
+		printf("ERROR: %s: cannot infer the counts (faces %d, views %d, vertices %d, frames %d)\n", entry->vfFolder,
+			entry->iNumFaces, entry->numViews, entry->iNumVertices, entry->numFrames);
+		return false;
+	}
+	return true;
+}
+
+bool discoverDataset(const char *root, std::vector<DatasetEntry> &entries)
+{
+	entries.clear();
+	std::vector<std::pair<std::string, std::string> > pairs;
+	char path[400];
+	sprintf(path, "%s%s", root, DATASETMANIFEST);
+	FILE * myFile = fopen(path, "r");
+	if (myFile != NULL)
+	{
+		char line[300];
+		while (fgets(line, sizeof(line), myFile) != NULL)
+		{
+			char *comment = strchr(line, '#');
+			if (comment != NULL)
+				*comment = '\0';
+			char character[128], animation[128];
+			if (sscanf(line, "%127s %127s", character, animation) == 2)
+				pairs.push_back(std::make_pair(std::string(character), std::string(animation)));
+		}
+		fclose(myFile);
+	}
+	else
+	{
+		std::vector<std::string> characters = listFolders(root);
+		for (size_t i = 0; i < characters.size(); i++)
+		{
+			std::string characterFolder = std::string(root) + characters[i] + "/";
+			std::vector<std::string> animations = listFolders(characterFolder.c_str());
+			for (size_t j = 0; j < animations.size(); j++)
+			{
+				std::string facePath = characterFolder + animations[j] + "/face.txt";
+				if (fileExists(facePath.c_str()))
+					pairs.push_back(std::make_pair(characters[i], animations[j]));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		DatasetEntry entry;
+		if (inspectAnimationFolder(root, pairs[i].first.c_str(), pairs[i].second.c_str(), &entry))
+			entries.push_back(entry);
+	}
+	if (entries.empty())
+	{
+		printf("ERROR: no animations found under %s\n", root);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+// one animation of the VerticeFace library: <root>/<character>/<animation>/ with face.txt, newViewpoint3.txt and
+// either frame<N>v.txt files or the skinning files; the counts are read from the data, never from tables
+struct DatasetEntry
+{
+	char character[64];
+	char animation[64];
+	char vfFolder[300];  // with the trailing '/'
+	int iNumVertices;
+	int iNumFaces;
+	int numFrames;
+	int numViews;
+};
+
+// optional <root>/manifest.txt: one "character animation" pair per line, '#' starts a comment.
+// Without a manifest every <character>/<animation> folder that has a face.txt is taken, sorted by name.
+#define DATASETMANIFEST "manifest.txt"
+
+// fills entries with the animations under root; folders whose counts cannot be inferred are reported and skipped
+bool discoverDataset(const char *root, std::vector<DatasetEntry> &entries);
+
+// infers the counts of one animation folder: from its animation cache header if there is a valid one,
+// otherwise by counting the values of the text files and the frame files present
+bool inspectAnimationFolder(const char *root, const char *character, const char *animation, DatasetEntry *entry);
@@ -0,0 +1,193 @@
+#include "glContext.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#if defined(HAVE_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static GLContextBackend gBackend = GLCONTEXT_GLFW;
+static GLFWwindow *gContextWindow = NULL;
+#if defined(HAVE_EGL)
+static EGLDisplay gDisplay = EGL_NO_DISPLAY;
+static EGLContext gContext = EGL_NO_CONTEXT;
+#endif
+
+static void OnError(int errorCode, const char* msg) {
+	throw std::runtime_error(msg);
+}
+
+static bool createGLFWContext(int iWidth, int iHeight, bool bVisible)
+{
+	glfwSetErrorCallback(OnError);
+	if (!glfwInit())
+	{
+		printf("ERROR: glfwInit failed\n");
+		return false;
+	}
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	glfwWindowHint(GLFW_VISIBLE, bVisible ? GL_TRUE : GL_FALSE);
+	gContextWindow = glfwCreateWindow(iWidth, iHeight, bVisible ? "openglTutrials" : "", NULL, NULL);
+	if (!gContextWindow)
+	{
+		printf("ERROR: glfwCreateWindow failed, a GL 4.5 core context is needed\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(gContextWindow);
+	return true;
+}
+
+#if defined(HAVE_EGL)
+static bool hasExtension(const char *extensions, const char *name)
+{
+	size_t length = strlen(name);
+	for (const char *p = extensions; p != NULL && (p = strstr(p, name)) != NULL; p += length)
+	{
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+// Mesa's surfaceless platform first, then the first EGL device, then the default display
+static EGLDisplay openEGLDisplay()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+	{
+		EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display != EGL_NO_DISPLAY)
+			return display;
+	}
+	PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	if (getPlatformDisplay != NULL && queryDevices != NULL && hasExtension(clientExtensions, "EGL_EXT_platform_device"))
+	{
+		EGLDeviceEXT device;
+		EGLint numDevices = 0;
+		if (queryDevices(1, &device, &numDevices) && numDevices > 0)
+		{
+			EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+			if (display != EGL_NO_DISPLAY)
+				return display;
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool createEGLContext()
+{
+	gDisplay = openEGLDisplay();
+	if (gDisplay == EGL_NO_DISPLAY || !eglInitialize(gDisplay, NULL, NULL))
+	{
+		printf("ERROR: no EGL display\n");
+		gDisplay = EGL_NO_DISPLAY;
+		return false;
+	}
+	if (!hasExtension(eglQueryString(gDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("ERROR: the EGL display has no surfaceless desktop GL\n");
+		destroyGLContext();
+		return false;
+	}
+	// no surface is ever made, so any surface type will do
+	const EGLint configAttribs[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(gDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+	{
+		printf("ERROR: no EGL config for desktop GL\n");
+		destroyGLContext();
+		return false;
+	}
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	gContext = eglCreateContext(gDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (gContext == EGL_NO_CONTEXT || !eglMakeCurrent(gDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, gContext))
+	{
+		printf("ERROR: eglCreateContext failed, a GL 4.5 core context is needed\n");
+		destroyGLContext();
+		return false;
+	}
+	return true;
+}
+#endif
+
+bool createGLContext(GLContextBackend backend, int iWidth, int iHeight, bool bVisible)
+{
+	gBackend = backend;
+	if (backend == GLCONTEXT_GLFW)
+		return createGLFWContext(iWidth, iHeight, bVisible);
+#if defined(HAVE_EGL)
+	return createEGLContext();
+#else
+	printf("ERROR: built without EGL (HAVE_EGL)\n");
+	return false;
+#endif
+}
+
+void bindGLContext(bool bCurrent)
+{
+	if (gBackend == GLCONTEXT_GLFW)
+	{
+		glfwMakeContextCurrent(bCurrent ? gContextWindow : NULL);
+		return;
+	}
+#if defined(HAVE_EGL)
+	eglMakeCurrent(gDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, bCurrent ? gContext : EGL_NO_CONTEXT);
+#endif
+}
+
+void swapGLContext()
+{
+	if (gBackend == GLCONTEXT_GLFW && gContextWindow != NULL)
+		glfwSwapBuffers(gContextWindow);
+}
+
+void destroyGLContext()
+{
+	if (gBackend == GLCONTEXT_GLFW)
+	{
+		if (gContextWindow != NULL)
+			glfwDestroyWindow(gContextWindow);
+		gContextWindow = NULL;
+		glfwTerminate();
+		return;
+	}
+#if defined(HAVE_EGL)
+	if (gDisplay != EGL_NO_DISPLAY)
+	{
+		eglMakeCurrent(gDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (gContext != EGL_NO_CONTEXT)
+			eglDestroyContext(gDisplay, gContext);
+		eglTerminate(gDisplay);
+	}
+	gContext = EGL_NO_CONTEXT;
+	gDisplay = EGL_NO_DISPLAY;
+#endif
+}
+
+bool parseGLContextBackend(const char *name, GLContextBackend *backend)
+{
+	if (strcmp(name, "glfw") == 0)
+		*backend = GLCONTEXT_GLFW;
+	else if (strcmp(name, "egl") == 0)
+		*backend = GLCONTEXT_EGL;
+	else
+		return false;
+	return true;
+}
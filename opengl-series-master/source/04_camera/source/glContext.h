@@ -0,0 +1,26 @@
+#pragma once
+
+// GL 4.5 core context of the overdraw evaluator. The evaluation renders into framebuffer objects only, so the
+// context just has to be current: GLFW needs a window (hidden unless bVisible), EGL makes a surfaceless context
+// for display-less nodes, e.g. on Mesa llvmpipe. The EGL backend is only built with HAVE_EGL.
+
+enum GLContextBackend
+{
+	GLCONTEXT_GLFW,
+	GLCONTEXT_EGL
+};
+
+// makes the context current; false after an ERROR line when the backend is not available
+bool createGLContext(GLContextBackend backend, int iWidth, int iHeight, bool bVisible);
+
+// makes the context current on the calling thread (bCurrent) or releases it from there, so that one thread at a
+// time can render from a pool
+void bindGLContext(bool bCurrent);
+
+// shows what was drawn into the default framebuffer (GLFW window only)
+void swapGLContext();
+
+void destroyGLContext();
+
+// "glfw" or "egl"
+bool parseGLContextBackend(const char *name, GLContextBackend *backend);
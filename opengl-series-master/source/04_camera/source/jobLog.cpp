@@ -0,0 +1,116 @@
+#include "jobLog.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+
+#if defined(_MSC_VER)
+#define JOBLOG_THREAD __declspec(thread)
+#else
+#define JOBLOG_THREAD __thread
+#endif
+
+// buffer of the job the thread runs, NULL outside a job
+static JOBLOG_THREAD std::string *threadJobLog = NULL;
+static std::mutex stdoutMutex;
+
+// std::cout buffer that appends to the job buffer of the writing thread, or passes on to the original buffer
+class JobLogBuf : public std::streambuf
+{
+public:
+	explicit JobLogBuf(std::streambuf *stdoutBuf) : stdoutBuf(stdoutBuf) {}
+
+protected:
+	virtual int overflow(int c)
+	{
+		if (c == EOF)
+			return 0;
+		char ch = (char)c;
+		return xsputn(&ch, 1) == 1 ? c : EOF;
+	}
+
+	virtual std::streamsize xsputn(const char *s, std::streamsize n)
+	{
+		if (threadJobLog != NULL)
+		{
+			threadJobLog->append(s, (size_t)n);
+			return n;
+		}
+		return stdoutBuf->sputn(s, n);
+	}
+
+	virtual int sync()
+	{
+		return threadJobLog != NULL ? 0 : stdoutBuf->pubsync();
+	}
+
+private:
+	std::streambuf *stdoutBuf;
+};
+
+// put in front of std::cout on the first job, for the rest of the run
+static void installJobLogBuf()
+{
+	static std::once_flag once;
+	std::call_once(once, []() {
+		static JobLogBuf buf(std::cout.rdbuf());
+		std::cout.rdbuf(&buf);
+	});
+}
+
+void jobPrintf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	if (threadJobLog == NULL)
+	{
+		vprintf(format, args);
+		va_end(args);
+		return;
+	}
+	char text[1024];
+	int n = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	if (n < 0)
+		return;
+	if (n < (int)sizeof(text))
+	{
+		threadJobLog->append(text, n);
+		return;
+	}
+	// longer than the stack buffer
+	std::string longText(n + 1, '\0');
+	va_start(args, format);
+	vsnprintf(&longText[0], n + 1, format, args);
+	va_end(args);
+	threadJobLog->append(longText.c_str(), n);
+}
+
+void beginJobLog()
+{
+	installJobLogBuf();
+	delete threadJobLog;
+	threadJobLog = new std::string();
+}
+
+std::string endJobLog()
+{
+	std::string log;
+	if (threadJobLog != NULL)
+	{
+		log.swap(*threadJobLog);
+		delete threadJobLog;
+		threadJobLog = NULL;
+	}
+	return log;
+}
+
+void printJobLog(const std::string &log)
+{
+	std::unique_lock<std::mutex> lock(stdoutMutex);
+	std::cout.flush();
+	fwrite(log.data(), 1, log.size(), stdout);
+	fflush(stdout);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+// Output of the batch jobs: while a thread runs a job (between beginJobLog and endJobLog), what it writes with
+// jobPrintf or to std::cout is kept in a buffer of that thread and the whole log is printed at once when the job
+// ends, so jobs that run side by side do not interleave. Outside a job both go straight to stdout. Pool threads
+// that help a job with parallelFor are not inside it, their output is not buffered.
+
+// printf that goes to the job buffer of the calling thread
+void jobPrintf(const char *format, ...);
+
+// starts buffering the output of the calling thread
+void beginJobLog();
+
+// stops buffering and returns the buffered text
+std::string endJobLog();
+
+// prints a finished job log to stdout in one piece
+void printJobLog(const std::string &log);
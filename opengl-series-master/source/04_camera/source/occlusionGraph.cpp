@@ -0,0 +1,258 @@
+#include "occlusionGraph.h"
+#include "ordering.h"
+#include "threadPool.h"
+
+#include <algorithm>
+
+struct PixelPatch
+{
+	float z;
+	int patchId;
+};
+
+static bool pixelPatchNearer(const PixelPatch &a, const PixelPatch &b)
+{
+	return a.z < b.z || (a.z == b.z && a.patchId < b.patchId);
+}
+
+void buildOcclusionGraph(const PatchCoverage *coverage, OcclusionGraph *graph)
+{
+	int numPatches = coverage->numPatches, numPixels = coverage->numPixels;
+	graph->numPatches = numPatches;
+	graph->edgeStart.assign(numPatches + 1, 0);
+	graph->edges.clear();
+
+	// front depth of every patch at every pixel, bucketed by pixel
+	std::vector<int> pixelStart(numPixels + 1, 0);
+	for (size_t r = 0; r < coverage->runs.size(); r++)
+		pixelStart[coverage->runs[r].pixel + 1]++;
+	for (int i = 0; i < numPixels; i++)
+		pixelStart[i + 1] += pixelStart[i];
+	std::vector<int> fill(pixelStart.begin(), pixelStart.end() - 1);
+	std::vector<PixelPatch> layers(coverage->runs.size());
+	for (int patchId = 0; patchId < numPatches; patchId++)
+	{
+		const float *d = coverage->depths.empty() ? NULL : &coverage->depths[0] + coverage->patchDepths[patchId];
+		for (int r = coverage->patchRuns[patchId]; r < coverage->patchRuns[patchId + 1]; r++)
+		{
+			int n = coverage->runs[r].numDepths;
+			PixelPatch layer = { d[n - 1], patchId };
+			layers[fill[coverage->runs[r].pixel]++] = layer;
+			d += n;
+		}
+	}
+
+	// every nearer/farther pair of a pixel is one unit of weight
+	std::vector<long long> pairs;
+	for (int i = 0; i < numPixels; i++)
+	{
+		std::sort(layers.begin() + pixelStart[i], layers.begin() + pixelStart[i + 1], pixelPatchNearer);
+		for (int a = pixelStart[i]; a < pixelStart[i + 1]; a++)
+			for (int b = a + 1; b < pixelStart[i + 1]; b++)
+				pairs.push_back(((long long)layers[a].patchId << 32) | layers[b].patchId);
+	}
+	std::sort(pairs.begin(), pairs.end());
+	for (size_t i = 0; i < pairs.size();)
+	{
+		size_t j = i;
+		while (j < pairs.size() && pairs[j] == pairs[i])
+			j++;
+		OcclusionEdge edge = { (int)(pairs[i] & 0xffffffff), (int)(j - i) };
+		graph->edges.push_back(edge);
+		graph->edgeStart[(int)(pairs[i] >> 32) + 1]++;
+		i = j;
+	}
+	for (int p = 0; p < numPatches; p++)
+		graph->edgeStart[p + 1] += graph->edgeStart[p];
+	graph->edges.shrink_to_fit();
+}
+
+void buildOcclusionGraphCache(const CoverageCache *coverage, OcclusionGraphCache *cache, ThreadPool *pool)
+{
+	cache->numFrames = coverage->numFrames;
+	cache->numViews = coverage->numViews;
+	cache->graphs.clear();
+	cache->graphs.resize(coverage->coverage.size());
+	parallelFor(pool, 0, (int)coverage->coverage.size(), [&](int i) {
+		buildOcclusionGraph(&coverage->coverage[i], &cache->graphs[i]);
+	});
+}
+
+void mergeOcclusionGraphs(const OcclusionGraph *const *graphs, int numGraphs, OcclusionGraph *merged)
+{
+	int numPatches = numGraphs > 0 ? graphs[0]->numPatches : 0;
+	merged->numPatches = numPatches;
+	merged->edgeStart.assign(numPatches + 1, 0);
+	merged->edges.clear();
+	// one source patch at a time, accumulated into a dense row
+	std::vector<int> row(numPatches, 0);
+	std::vector<int> touched;
+	for (int p = 0; p < numPatches; p++)
+	{
+		touched.clear();
+		for (int g = 0; g < numGraphs; g++)
+		{
+			const OcclusionGraph *graph = graphs[g];
+			for (int e = graph->edgeStart[p]; e < graph->edgeStart[p + 1]; e++)
+			{
+				const OcclusionEdge &edge = graph->edges[e];
+				if (row[edge.to] == 0)
+					touched.push_back(edge.to);
+				row[edge.to] += edge.weight;
+			}
+		}
+		std::sort(touched.begin(), touched.end());
+		for (size_t i = 0; i < touched.size(); i++)
+		{
+			OcclusionEdge edge = { touched[i], row[touched[i]] };
+			merged->edges.push_back(edge);
+			row[touched[i]] = 0;
+		}
+		merged->edgeStart[p + 1] = (int)merged->edges.size();
+	}
+}
+
+long long feedbackArcSetOrder(const OcclusionGraph *graph, const PatchId *pusTieOrder, PatchId *pusPatchOrderOut)
+{
+	int numPatches = graph->numPatches;
+	std::vector<int> tieOrder(numPatches);
+	for (int i = 0; i < numPatches; i++)
+		tieOrder[i] = pusTieOrder != NULL ? pusTieOrder[i] : i;
+
+	// incoming edges, as (source, weight)
+	std::vector<int> inStart(numPatches + 1, 0);
+	for (size_t e = 0; e < graph->edges.size(); e++)
+		inStart[graph->edges[e].to + 1]++;
+	for (int p = 0; p < numPatches; p++)
+		inStart[p + 1] += inStart[p];
+	std::vector<OcclusionEdge> inEdges(graph->edges.size());
+	std::vector<int> fill(inStart.begin(), inStart.end() - 1);
+	std::vector<long long> inWeight(numPatches, 0), outWeight(numPatches, 0);
+	for (int p = 0; p < numPatches; p++)
+	{
+		for (int e = graph->edgeStart[p]; e < graph->edgeStart[p + 1]; e++)
+		{
+			const OcclusionEdge &edge = graph->edges[e];
+			OcclusionEdge in = { p, edge.weight };
+			inEdges[fill[edge.to]++] = in;
+			outWeight[p] += edge.weight;
+			inWeight[edge.to] += edge.weight;
+		}
+	}
+
+	// sinks are taken before sources, both in tie order; weights only drop, so a queued patch stays what it was
+	std::vector<char> removed(numPatches, 0);
+	std::vector<int> sinks, sources, front, back;
+	for (int i = 0; i < numPatches; i++)
+	{
+		int p = tieOrder[i];
+		if (inWeight[p] == 0)
+			sources.push_back(p);
+		else if (outWeight[p] == 0)
+			sinks.push_back(p);
+	}
+	size_t nextSink = 0, nextSource = 0;
+	int numLeft = numPatches;
+	while (numLeft > 0)
+	{
+		int p = -1;
+		bool toBack = false;
+		while (p == -1 && nextSink < sinks.size())
+		{
+			p = sinks[nextSink++];
+			toBack = true;
+			if (removed[p])
+				p = -1;
+		}
+		while (p == -1 && nextSource < sources.size())
+		{
+			p = sources[nextSource++];
+			toBack = false;
+			if (removed[p])
+				p = -1;
+		}
+		if (p == -1)
+		{
+			long long best = 0;
+			for (int i = 0; i < numPatches; i++)
+			{
+				int q = tieOrder[i];
+				if (!removed[q] && (p == -1 || outWeight[q] - inWeight[q] > best))
+				{
+					p = q;
+					best = outWeight[q] - inWeight[q];
+				}
+			}
+		}
+		removed[p] = 1;
+		numLeft--;
+		if (toBack)
+			back.push_back(p);
+		else
+			front.push_back(p);
+		for (int e = graph->edgeStart[p]; e < graph->edgeStart[p + 1]; e++)
+		{
+			int q = graph->edges[e].to;
+			if (removed[q])
+				continue;
+			inWeight[q] -= graph->edges[e].weight;
+			if (inWeight[q] == 0)
+				sources.push_back(q);
+		}
+		for (int e = inStart[p]; e < inStart[p + 1]; e++)
+		{
+			int q = inEdges[e].to;
+			if (removed[q])
+				continue;
+			outWeight[q] -= inEdges[e].weight;
+			if (outWeight[q] == 0 && inWeight[q] > 0)
+				sinks.push_back(q);
+		}
+	}
+
+	int k = 0;
+	std::vector<int> rank(numPatches);
+	for (size_t i = 0; i < front.size(); i++, k++)
+	{
+		pusPatchOrderOut[k] = (PatchId)front[i];
+		rank[front[i]] = k;
+	}
+	for (size_t i = back.size(); i-- > 0; k++)
+	{
+		pusPatchOrderOut[k] = (PatchId)back[i];
+		rank[back[i]] = k;
+	}
+	long long backward = 0;
+	for (int p = 0; p < numPatches; p++)
+		for (int e = graph->edgeStart[p]; e < graph->edgeStart[p + 1]; e++)
+			if (rank[graph->edges[e].to] < rank[p])
+				backward += graph->edges[e].weight;
+	return backward;
+}
+
+long long occlusionOrder(const OcclusionGraphCache *cache, const clusterAssign *members, int numMembers, const PatchId *pusTieOrder,
+	PatchId *pusPatchOrderOut)
+{
+	std::vector<const OcclusionGraph *> graphs(numMembers);
+	for (int i = 0; i < numMembers; i++)
+		graphs[i] = occlusionGraphAt(cache, members[i].frameId, members[i].viewId);
+	OcclusionGraph merged;
+	mergeOcclusionGraphs(numMembers > 0 ? &graphs[0] : NULL, numMembers, &merged);
+	if (numMembers == 0)
+	{
+		merged.numPatches = cache->graphs.empty() ? 0 : cache->graphs[0].numPatches;
+		merged.edgeStart.assign(merged.numPatches + 1, 0);
+	}
+	return feedbackArcSetOrder(&merged, pusTieOrder, pusPatchOrderOut);
+}
+
+long long occlusionGraphCacheSize(const OcclusionGraphCache *cache)
+{
+	long long size = 0;
+	for (size_t i = 0; i < cache->graphs.size(); i++)
+	{
+		const OcclusionGraph &g = cache->graphs[i];
+		size += sizeof(OcclusionGraph) + g.edgeStart.capacity() * sizeof(int) + g.edges.capacity() * sizeof(OcclusionEdge);
+	}
+	return size;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "patchCoverage.h"
+
+class ThreadPool;
+class clusterAssign;
+
+// Patch occlusion graph of one (frame, view): an edge P -> Q weighs the pixels where the front of P is nearer
+// than the front of Q. Drawing Q before P costs about that many overdrawn pixels, so a good ordering is one whose
+// backward edges weigh little: a minimum feedback arc set, approximated with the greedy of Eades, Lin and Smyth.
+// The graphs come from the patch coverage cache and are kept per (frame, view), so clustering iterations only
+// merge the graphs of a cluster's members and order the result.
+
+struct OcclusionEdge
+{
+	int to;
+	int weight;
+};
+
+// edges of patch p are edges[edgeStart[p], edgeStart[p + 1]), sorted by target
+struct OcclusionGraph
+{
+	int numPatches;
+	std::vector<int> edgeStart;
+	std::vector<OcclusionEdge> edges;
+};
+
+// graph of every (frame, view) of a coverage cache, frame major
+struct OcclusionGraphCache
+{
+	int numFrames;
+	int numViews;
+	std::vector<OcclusionGraph> graphs;
+};
+
+void buildOcclusionGraph(const PatchCoverage *coverage, OcclusionGraph *graph);
+
+void buildOcclusionGraphCache(const CoverageCache *coverage, OcclusionGraphCache *cache, ThreadPool *pool);
+
+inline const OcclusionGraph *occlusionGraphAt(const OcclusionGraphCache *cache, int frameId, int viewId)
+{
+	return &cache->graphs[frameId * cache->numViews + viewId];
+}
+
+// sum of the edge weights of several graphs over the same patches
+void mergeOcclusionGraphs(const OcclusionGraph *const *graphs, int numGraphs, OcclusionGraph *merged);
+
+// Eades-Lin-Smyth: sinks go to the back, sources (and unconnected patches) to the front, otherwise the patch with
+// the largest out - in weight goes to the front. Ties follow pusTieOrder (may be NULL for patch index order).
+// Returns the weight of the backward edges of the ordering.
+long long feedbackArcSetOrder(const OcclusionGraph *graph, const PatchId *pusTieOrder, PatchId *pusPatchOrderOut);
+
+// ordering of the merged graphs of the (frame, view) members of a cluster
+long long occlusionOrder(const OcclusionGraphCache *cache, const clusterAssign *members, int numMembers, const PatchId *pusTieOrder,
+	PatchId *pusPatchOrderOut);
+
+// bytes held by the cache
+long long occlusionGraphCacheSize(const OcclusionGraphCache *cache);
@@ -2,7 +2,6 @@
 
 // third-party libraries
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/ext.hpp>
@@ -10,6 +9,8 @@
 
 // standard C++ libraries
 #include <cassert>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
@@ -18,139 +19,211 @@
 #include <functional>
 #include <algorithm>
 #include <memory>
+#include <mutex>
 #include <limits>
 #include <iomanip>
 #include <ctime>
+#include <chrono>
 
 // tdogl classes
 #include "tdogl/Program.h"
 #include "tdogl/Texture.h"
-#include "tdogl/Camera.h"
+
+#include "animationCache.h"
+#include "batch.h"
+#include "dataset.h"
+#include "glContext.h"
+#include "jobLog.h"
+#include "occlusionGraph.h"
+#include "ordering.h"
+#include "patchOrder.h"
+#include "rayEstimator.h"
+#include "skinning.h"
+#include "softRaster.h"
+#include "textLoader.h"
+#include "threadPool.h"
+#include "vcacheSim.h"
 #define random(x) (rand()%x)
 
 using std::sort;
 #define max(a,b) ((a) > (b) ? (a) : (b))
 
-#define cf(p, c, v) (((p-c+2*v) > iCacheSize) ? (0) : (p-c))
-
 //#define INUMVERTICES 6675
 //#define INUMFACES 12610
 //#define INUMFRAMES 30
 #define INUMVIEWS 162
-#define CANVASXNUMS 13
-#define CANVASYNUMS 13
-#define INUMCLUSTERS 5
 #define CANVASHEIGHT 50
 #define CANVASWIDTH 50
 
-
-// constants
-const glm::vec2 SCREEN_SIZE(CANVASWIDTH*CANVASXNUMS, CANVASHEIGHT*CANVASYNUMS);
-
 // globals
-bool offScreen = false;
-GLFWwindow* gWindow = NULL;
-tdogl::Camera gCamera;
+// hide the window; every view is rendered into framebuffer objects either way, on screen only the first view is
+// shown. Always on with the EGL context, which has no window
+bool offScreen = true;
+// GLFW window, or surfaceless EGL for display-less nodes (04_camera -context egl ...)
+GLContextBackend contextBackend = GLCONTEXT_GLFW;
+// reduce the views to per view drawn/shown counts with a compute shader, only 2 x numEvalLayers counters are read back
+bool gpuReduce = true;
+// count the fragments that pass the depth test exactly in an R32UI image instead of blending 0.2 into the 8 bit red
+// channel, which saturates after five layers; reduced on the GPU
+bool exactCount = false;
+// switches of processAnimation, -name on the command line turns one on and -noName off (04_camera -miniBatch ...)
+// stream the frames from the text files instead of mapping the whole animation; memory is then
+// O(frames x patches) instead of O(frames x vertices), for long takes that do not fit
+bool streamFrames = false;
+// print the simulated ACMR/ATVR of the input and the FanVertCluster order for the cache models and sizes
+bool vcacheReport = false;
+// print the overdraw of the input, the FanVertCluster order and every cluster ordering, measured with the
+// software rasterizer on CANVASWIDTH x CANVASHEIGHT views (frames streamed from text only use the first frame)
+bool overdrawReport = false;
+// replace the distance sorted initial means by the feedback arc set ordering of the occlusion graphs of their
+// view over all frames (needs the frames in memory, so not with streamFrames)
+bool occlusionMeans = false;
+// compare the ray sampled overdraw estimate of the input, FanVertCluster and cluster orderings with the exact
+// software raster over all frames and views
+bool rayReport = false;
+// score the orderings of the clustering on the ray samples instead of the exact coverage, a few hundred rays
+// per view in place of rasterizing every one
+bool rayEvaluate = false;
+// score the orderings of the clustering with the exact fragment counts of the GL path (a GLEvaluator), the true
+// cost, rendering every frame the scored pairs use; with -context egl on a headless GPU
+bool glEvaluate = false;
+// Lloyd clustering of the (frame, view) pairs from the initial means, scored on the patch coverage cache of all
+// frames and views, until it converges or hits its iteration / time limit (needs the frames in memory)
+bool lloyd = true;
+// mini-batch clustering in place of the Lloyd one, for long animations and dense view sets; only the sampled
+// pairs are rasterized, the coverage of the last batch size of them is kept
+bool miniBatch = false;
+// choose the number of orderings instead of numClusters: the Lloyd clustering for 1 .. maxClusters orderings up
+// to the first within targetOverdraw, or before their index buffers would exceed indexByteBudget
+bool autoClusters = false;
+struct SwitchFlag
+{
+	const char *name;
+	bool *pbValue;
+};
+static const SwitchFlag switchFlags[] = {
+	{ "streamFrames", &streamFrames },
+	{ "vcacheReport", &vcacheReport },
+	{ "overdrawReport", &overdrawReport },
+	{ "occlusionMeans", &occlusionMeans },
+	{ "rayReport", &rayReport },
+	{ "rayEvaluate", &rayEvaluate },
+	{ "glEvaluate", &glEvaluate },
+	{ "lloyd", &lloyd },
+	{ "miniBatch", &miniBatch },
+	{ "autoClusters", &autoClusters },
+};
+
+// sets the switch of -name or -noName (the first letter of name capitalized), false if arg is neither
+static bool parseSwitchFlag(const char *arg)
+{
+	if (arg[0] != '-')
+		return false;
+	for (size_t i = 0; i < sizeof(switchFlags) / sizeof(switchFlags[0]); i++)
+	{
+		const char *name = switchFlags[i].name;
+		if (strcmp(arg + 1, name) == 0)
+		{
+			*switchFlags[i].pbValue = true;
+			return true;
+		}
+		if (strncmp(arg + 1, "no", 2) == 0 && arg[3] == toupper(name[0]) && strcmp(arg + 4, name + 1) == 0)
+		{
+			*switchFlags[i].pbValue = false;
+			return true;
+		}
+	}
+	return false;
+}
 tdogl::Program* gProgram = NULL;
+tdogl::Program* gReduceProgram = NULL;
 GLuint gVAO = 0;
 GLuint gVBO = 0;
 GLuint eboID = 0;
 GLuint ac_buffer = 0;
-GLuint pixel_buffer = 0;
+// views evaluated on the GPU: every (mean, view) is rendered into its own layer of a 2D texture array, mean major;
+// the layers are split in pages of at most GL_MAX_ARRAY_TEXTURE_LAYERS with one multi draw per page
+int numEvalViews = INUMVIEWS;
+int numEvalMeans = 1;
+int numEvalLayers = INUMVIEWS;
+int viewWidth = CANVASWIDTH;
+int viewHeight = CANVASHEIGHT;
+int layersPerPage = 0;
+// upper bound of layersPerPage, 0: GL_MAX_ARRAY_TEXTURE_LAYERS; the GL self check lowers it to cover several pages
+int maxPageLayers = 0;
+// when set, the per layer ratios of every evaluation are appended here instead of printed
+std::vector<float> *pEvalRatios = NULL;
+std::vector<GLuint> pageColors;
+std::vector<GLuint> pageDepths;
+std::vector<GLuint> pageFragmentCounts;
+std::vector<GLuint> pageFbos;
+// readback ring: the views (or their counts with gpuReduce) of evaluation N are copied into
+// pixelBuffers[N % PBORINGSIZE] and only mapped once its fence has signalled, while the next evaluations are rendered
+#define PBORINGSIZE 3
+GLuint pixelBuffers[PBORINGSIZE];
+GLsync pixelFences[PBORINGSIZE];
+int ringHead = 0;
+int ringPending = 0;
 GLuint atomicCounterArray[1];
 GLuint transformationMatrixBufferId;
-GLuint gColor;
-GLuint rboDepth;
-GLuint fbo;
-
-class Vector
+GLuint instanceLayerBufferId;
+// indirect draws of all means, the ones of page p are pageCommands[p, p + 1)
+GLuint indirectBufferId;
+std::vector<int> pageCommands;
+// layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
 {
-public:
-	float v[3];
-	Vector() {}
-	Vector(float a, float b, float c) { v[0] = a; v[1] = b; v[2] = c; }
-	Vector(float *a) { v[0] = a[0]; v[1] = a[1]; v[2] = a[2]; }
-	void operator+=(const Vector a) { v[0] += a.v[0]; v[1] += a.v[1]; v[2] += a.v[2]; }
-	void operator-=(const Vector a) { v[0] -= a.v[0]; v[1] -= a.v[1]; v[2] -= a.v[2]; }
-	Vector operator+(const Vector a) { return Vector(v[0] + a.v[0], v[1] + a.v[1], v[2] + a.v[2]); }
-	Vector operator-(const Vector a) { return Vector(v[0] - a.v[0], v[1] - a.v[1], v[2] - a.v[2]); }
-	Vector operator/(const float n) { return Vector(v[0] / n, v[1] / n, v[2] / n); }
-	void operator/=(const int n) { v[0] /= (float)n; v[1] /= (float)n; v[2] /= (float)n; }
-	void operator/=(const float n) { v[0] /= n; v[1] /= n; v[2] /= n; }
-	Vector operator*(const float a) { return Vector(v[0] * a, v[1] * a, v[2] * a); }
-	Vector operator*(const Vector a) { return Vector(v[0] * a.v[0], v[1] * a.v[1], v[2] * a.v[2]); }
-	Vector operator/(const Vector a) { return Vector(v[0] / a.v[0], v[1] / a.v[1], v[2] / a.v[2]); }
-	float length() { float w = v[0] * v[0] + v[1] * v[1] + v[2] * v[2]; return w > 0.f ? sqrtf(w) : 0.f; }
-	void normalize() { float w = v[0] * v[0] + v[1] * v[1] + v[2] * v[2]; if (w > 0.f) *this /= sqrtf(w); }
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLuint baseVertex;
+	GLuint baseInstance;
 };
 
-static float dot(const Vector a, const Vector b)
-{
-	return (a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]);
-}
-
-static Vector cross(const Vector a, const Vector b)
-{
-	return Vector(a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0]);
-}
-static float dist(const Vector a, const Vector b)
-{
-	Vector c = Vector(a);
-	return (c - b).length();
-}
-
-// structure used to sort patches
-class patchSort
-{
-public:
-	float dist;// distance
-	int id;//index
-};
-class clusterAssign
-{
-public:
-	int frameId;
-	int viewId;
-};
-bool sortfunc(const patchSort &a, const patchSort &b)
-{
-	return a.dist < b.dist;
-}
 // sort functions
 inline int min(const int a, const int b)
 {
 	return a < b ? a : b;
 }
-//function that computes size of scratch memory
-int FanVertScratchSize(int iNumVertices, int iNumFaces)
+
+// layers of page page
+static int pageViews(int page)
 {
-	return (iNumFaces * 22 + iNumVertices + 3) * sizeof(int);
+	return min(layersPerPage, numEvalLayers - page * layersPerPage);
 }
 
-
 // loads the vertex shader and fragment shader, and links them to make the global gProgram
 static void LoadShaders() {
 	std::vector<tdogl::Shader> shaders;
 	shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("vertex-shader.txt"), GL_VERTEX_SHADER));
-	shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("fragment-shader.txt"), GL_FRAGMENT_SHADER));
+	shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("geometry-shader.txt"), GL_GEOMETRY_SHADER));
+	shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(exactCount ? "fragment-count-shader.txt" : "fragment-shader.txt"), GL_FRAGMENT_SHADER));
 	gProgram = new tdogl::Program(shaders);
 	//std::cout << gProgram << std::endl;
+	if (gpuReduce)
+	{
+		std::vector<tdogl::Shader> reduceShaders;
+		reduceShaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(exactCount ? "overdraw-reduce-count-shader.txt" : "overdraw-reduce-shader.txt"), GL_COMPUTE_SHADER));
+		gReduceProgram = new tdogl::Program(reduceShaders);
+	}
 }
 
 
-// loads a triangle into the VAO global
-static void LoadTriangle(float * pfVertexPositionsIn, float * pfCameraPosiitons, int * piIndexBufferIn, int numVertices, int numFaces)
+// makes the VAO global once for the whole evaluation: the vertex buffer is sized for one frame and filled by
+// LoadFrame, the instance matrices are built once and the index buffers of all means are packed into one element
+// buffer, mean meanId starting at meanId * numFaces * 3. Instance g draws view g % numEvalViews of mean
+// g / numEvalViews into layer g % layersPerPage of its page.
+static void LoadTriangle(float * pfCameraPosiitons, int * piIndexBuffersIn, int numMeans, int numVertices, int numFaces)
 {
 	// make and bind the VAO
-	glGenVertexArrays(2, &gVAO);
+	glGenVertexArrays(1, &gVAO);
 	glBindVertexArray(gVAO);
 
 	// make and bind the VBO
 	glGenBuffers(1, &gVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, gVBO);
 
-	GLfloat * vertexData2 = (GLfloat *)pfVertexPositionsIn;
-	glBufferData(GL_ARRAY_BUFFER, numVertices*3*4, vertexData2, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, numVertices*3*4, NULL, GL_DYNAMIC_DRAW);
 	// connect the xyz to the "vert" attribute of the vertex shader
 	glEnableVertexAttribArray(gProgram->attrib("vert"));
 	glVertexAttribPointer(gProgram->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 0, NULL);
@@ -158,30 +231,12 @@ static void LoadTriangle(float * pfVertexPositionsIn, float * pfCameraPosiitons,
 	glGenBuffers(1, &transformationMatrixBufferId);
 	glBindBuffer(GL_ARRAY_BUFFER, transformationMatrixBufferId);
 
-	// setup gCamera
-	gCamera.setPosition(glm::vec3(0.0f, 0.0f, 0.0f));
-	//std::cout << "X: "<<SCREEN_SIZE.x << " Y " << SCREEN_SIZE.y << std::endl;
-	gCamera.setViewportAspectRatio(SCREEN_SIZE.x / SCREEN_SIZE.y);
-	gCamera.setFieldOfView(40.0f);
-	gCamera.setNearAndFarPlanes(1.0f, 2000.0f);
-
-	gCamera.setDirection(glm::vec3(-50, -50, -200));
-
-	float translatePos[CANVASXNUMS];
-	for (int i = 0; i < CANVASXNUMS; i++){
-		translatePos[i] = -1 + 2.0 / (CANVASXNUMS * 2) + (2.0 / CANVASXNUMS)*i;
-	}
-	glm::mat4 fullTransform[INUMVIEWS]; 
-	int i,cameraId,canvasX,canvasY;
-	double result, x = 1;
-	for (cameraId = 0; cameraId < INUMVIEWS; cameraId++)
-	{
-		canvasX = cameraId%CANVASXNUMS; //width
-		canvasY = cameraId / CANVASXNUMS; //height
-		gCamera.setPosition(glm::vec3(pfCameraPosiitons[cameraId * 3], pfCameraPosiitons[cameraId * 3 + 1], pfCameraPosiitons[cameraId * 3 + 2]));
-		gCamera.lookAt(glm::vec3(0.0f, 0.0f, 0.0f));
-		fullTransform[cameraId] = glm::translate(glm::mat4(1.0), glm::vec3(translatePos[canvasX], translatePos[canvasY], 0.0f))*glm::scale(glm::mat4(1.0), glm::vec3(1.0/CANVASXNUMS, 1.0 / CANVASYNUMS, 1.0))*gCamera.matrix();
-	}
+	// per view camera, shared with the software rasterizer; each view fills its own layer, so the matrices are
+	// used as they are (column major, as glm::mat4), once for every mean
+	std::vector<float> pfViewMatrices(numEvalLayers * 16);
+	buildViewMatrices(pfCameraPosiitons, numEvalViews, (float)viewWidth / viewHeight, &pfViewMatrices[0]);
+	for (int j = 1; j < numEvalMeans; j++)
+		std::copy(pfViewMatrices.begin(), pfViewMatrices.begin() + numEvalViews * 16, pfViewMatrices.begin() + j * numEvalViews * 16);
 
 	int pos = glGetAttribLocation(gProgram->object(), "fullTransformMatrix");
 	int pos1 = pos + 0;
@@ -189,7 +244,7 @@ static void LoadTriangle(float * pfVertexPositionsIn, float * pfCameraPosiitons,
 	int pos3 = pos + 2;
 	int pos4 = pos + 3;
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(fullTransform), &fullTransform, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, pfViewMatrices.size() * sizeof(float), &pfViewMatrices[0], GL_STATIC_DRAW);
 	glEnableVertexAttribArray(pos1);
 	glEnableVertexAttribArray(pos2);
 	glEnableVertexAttribArray(pos3);
@@ -205,14 +260,44 @@ static void LoadTriangle(float * pfVertexPositionsIn, float * pfCameraPosiitons,
 	glVertexAttribDivisor(pos3, 1);
 	glVertexAttribDivisor(pos4, 1);
 
+	std::vector<GLint> instanceLayers(numEvalLayers);
+	for (int g = 0; g < numEvalLayers; g++)
+		instanceLayers[g] = g % layersPerPage;
+	glGenBuffers(1, &instanceLayerBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceLayerBufferId);
+	glBufferData(GL_ARRAY_BUFFER, instanceLayers.size() * sizeof(GLint), &instanceLayers[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(gProgram->attrib("instanceLayer"));
+	glVertexAttribIPointer(gProgram->attrib("instanceLayer"), 1, GL_INT, 0, NULL);
+	glVertexAttribDivisor(gProgram->attrib("instanceLayer"), 1);
+
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
-	//need update
-	GLuint * indices = (GLuint *)piIndexBufferIn;
+	// one command per mean and page it has layers in
+	std::vector<DrawElementsIndirectCommand> commands;
+	pageCommands.assign(1, 0);
+	for (int page = 0; page * layersPerPage < numEvalLayers; page++)
+	{
+		int first = page * layersPerPage, last = first + pageViews(page);
+		for (int j = 0; j < numEvalMeans; j++)
+		{
+			int from = max(first, j * numEvalViews), to = min(last, (j + 1) * numEvalViews);
+			if (from >= to)
+				continue;
+			DrawElementsIndirectCommand command = { (GLuint)numFaces * 3, (GLuint)(to - from), (GLuint)(j * numFaces * 3), 0, (GLuint)from };
+			commands.push_back(command);
+		}
+		pageCommands.push_back((int)commands.size());
+	}
+	glGenBuffers(1, &indirectBufferId);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferId);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	GLuint * indices = (GLuint *)piIndexBuffersIn;
 	glGenBuffers(1, &eboID);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numFaces*3*4, indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)numMeans*numFaces*3*4, indices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	//// setup gCamera
@@ -223,76 +308,182 @@ static void LoadTriangle(float * pfVertexPositionsIn, float * pfCameraPosiitons,
 	//gCamera.setDirection(glm::vec3(-50, -50, -200));
 }
 
+// streams the vertex positions of one frame into the VBO made by LoadTriangle
+static void LoadFrame(float * pfVertexPositionsIn, int numVertices)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, gVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, numVertices*3*4, pfVertexPositionsIn);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void UnloadTriangle()
+{
+	glDeleteVertexArrays(1, &gVAO);
+	glDeleteBuffers(1, &gVBO);
+	glDeleteBuffers(1, &transformationMatrixBufferId);
+	glDeleteBuffers(1, &instanceLayerBufferId);
+	glDeleteBuffers(1, &eboID);
+	glDeleteBuffers(1, &indirectBufferId);
+	gVAO = 0; gVBO = 0; transformationMatrixBufferId = 0; instanceLayerBufferId = 0; eboID = 0; indirectBufferId = 0;
+}
+
 
-void overdrawRatio(){
-	// read pixels
-	int i, j;
-	bool bMalloc = false;
-	int * piScratch = NULL;
-	if (piScratch == NULL)
+// per view overdraw from the drawn and shown pixel counts of every layer (the views of every mean)
+void overdrawRatio(const GLuint * viewCounts){
+	float avgRatio;
+	for (int cameraId = 0; cameraId < numEvalLayers; cameraId++)
 	{
-		int iScratchSize = INUMVIEWS*CANVASHEIGHT*CANVASWIDTH*sizeof(int);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
+		avgRatio = (float)viewCounts[2 * cameraId] / (float)viewCounts[2 * cameraId + 1];
+		if (pEvalRatios != NULL)
+		{
+			pEvalRatios->push_back(avgRatio);
+			continue;
+		}
+		//std::cout << "drawn pixel numbers " << viewCounts[2 * cameraId] << std::endl;
+		//std::cout << "showed pixel numbers " << viewCounts[2 * cameraId + 1] << std::endl;
+		std::cout << "averageRatio" << avgRatio << std::endl;
 	}
-	int *piScratchBase = piScratch;
-	unsigned char * pixel = (unsigned char *)piScratch;
-	piScratch += INUMVIEWS*CANVASHEIGHT*CANVASWIDTH;
+}
 
-	if (offScreen)
-		//glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	else
-		glReadBuffer(GL_FRONT);
-	glReadPixels(0, 0, CANVASWIDTH * CANVASXNUMS, CANVASHEIGHT*CANVASYNUMS, GL_RED, GL_UNSIGNED_BYTE, pixel);
-	//glReadBuffer(GL_NONE);
-	//glBindBuffer(GL_READ_FRAMEBUFFER, 0);
+// per view overdraw of one readback of all layers (viewWidth x viewHeight bytes per view)
+void overdrawRatio(const unsigned char * pixel){
 	int drawnPixel,showedPixel,cameraId;
-	float avgRatios[INUMVIEWS];
+	std::vector<GLuint> viewCounts(2 * numEvalLayers);
 	//getchar();
-	int x, y;
-	for (cameraId = 0; cameraId < INUMVIEWS; cameraId++)
+	for (cameraId = 0; cameraId < numEvalLayers; cameraId++)
 	{
-		x = cameraId%CANVASXNUMS; //width
-		y = cameraId / CANVASXNUMS; //height
-
+		const unsigned char * layer = pixel + (size_t)cameraId * viewWidth * viewHeight;
 		drawnPixel = 0; showedPixel = 0;
-		for (int i = CANVASHEIGHT * y; i < CANVASHEIGHT*(y + 1); i++) //height
+		for (int i = 0; i < viewWidth * viewHeight; i++)
 		{
-			for (int j = CANVASWIDTH * x; j < CANVASWIDTH*(x + 1); j++)//width
+			if ((int)layer[i] > 0)
 			{
-				if ((int)pixel[i * CANVASWIDTH * CANVASXNUMS + j] > 0)
-				{
-					drawnPixel += round((float)pixel[i * CANVASWIDTH * CANVASXNUMS + j] / 51.0f);
-					showedPixel++;
-				}
+				drawnPixel += round((float)layer[i] / 51.0f);
+				showedPixel++;
 			}
 		}
-		avgRatios[cameraId] = (float)drawnPixel / (float)showedPixel;
-		//std::cout << "drawn pixel numbers " << drawnPixel << std::endl;
-		//std::cout << "showed pixel numbers " << showedPixel << std::endl;
-		std::cout << "averageRatio" << avgRatios[cameraId] << std::endl;
+		viewCounts[2 * cameraId] = drawnPixel;
+		viewCounts[2 * cameraId + 1] = showedPixel;
+	}
+	overdrawRatio(&viewCounts[0]);
+}
+
+// bytes of one ring slot
+static int readbackSize()
+{
+	return gpuReduce ? 2 * numEvalLayers * sizeof(GLuint) : numEvalLayers * viewWidth * viewHeight;
+}
+
+
+static void initReadbackRing()
+{
+	glGenBuffers(PBORINGSIZE, pixelBuffers);
+	for (int i = 0; i < PBORINGSIZE; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize(), NULL, GL_STREAM_READ);
+		pixelFences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	ringHead = 0;
+	ringPending = 0;
+}
+
+// waits for the oldest pending readback, maps it and reduces it
+static void finishOverdrawReadback()
+{
+	if (ringPending == 0)
+		return;
+	int slot = (ringHead - ringPending + PBORINGSIZE) % PBORINGSIZE;
+	GLenum waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	for (;;)
+	{
+		GLenum result = glClientWaitSync(pixelFences[slot], waitFlags, 1000000); // 1ms
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+			break;
+		waitFlags = 0;
+	}
+	glDeleteSync(pixelFences[slot]);
+	pixelFences[slot] = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+	const void * data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readbackSize(), GL_MAP_READ_BIT);
+	if (data != NULL)
+	{
+		if (gpuReduce)
+			overdrawRatio((const GLuint *)data);
+		else
+			overdrawRatio((const unsigned char *)data);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else
+	{
+		printf("ERROR: readback buffer cannot be mapped\n");
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	ringPending--;
+}
+
+// one work group per view writes the drawn and shown counts of its layer into the ring slot
+static void reduceOverdraw(GLuint slotBuffer)
+{
+	if (exactCount)
+	{
+		// the fragment counts are written by image atomics
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glUseProgram(gReduceProgram->object());
+	gReduceProgram->setUniform("viewSize", viewWidth, viewHeight);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, slotBuffer);
+	for (int page = 0; page * layersPerPage < numEvalLayers; page++)
+	{
+		gReduceProgram->setUniform("viewOffset", page * layersPerPage);
+		if (exactCount)
+			glBindImageTexture(0, pageFragmentCounts[page], 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32UI);
+		else
+			glBindImageTexture(0, pageColors[page], 0, GL_TRUE, 0, GL_READ_ONLY, GL_R8);
+		glDispatchCompute(pageViews(page), 1, 1);
 	}
-	if (piScratch - piScratchBase > 0)
+	// the counts are mapped after the fence
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	glUseProgram(0);
+}
+
+// starts the copy of the views just rendered (or of their counts) into the next ring slot, the oldest readback is
+// finished first when the ring is full
+static void queueOverdrawReadback()
+{
+	if (ringPending == PBORINGSIZE)
+		finishOverdrawReadback();
+	if (gpuReduce)
 	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+		reduceOverdraw(pixelBuffers[ringHead]);
 	}
-	if (bMalloc)
+	else
 	{
-		free(piScratchBase);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[ringHead]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		for (int page = 0; page * layersPerPage < numEvalLayers; page++)
+		{
+			int offset = page * layersPerPage * viewWidth * viewHeight;
+			glGetTextureImage(pageColors[page], 0, GL_RED, GL_UNSIGNED_BYTE, readbackSize() - offset, (void *)(size_t)offset);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	pixelFences[ringHead] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ringHead = (ringHead + 1) % PBORINGSIZE;
+	ringPending++;
 }
 
-static void Render(GLuint baseInstance,int numFaces) {
-	// clear everything
-	if (offScreen)
-		//glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glClearColor(0, 0, 0, 1); // black
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+static void drainOverdrawReadbacks()
+{
+	while (ringPending > 0)
+		finishOverdrawReadback();
+}
 
+// draws all means of the current frame, one glMultiDrawElementsIndirect per page
+static void Render() {
 	
 	// bind the program (the shaders)
 	glUseProgram(gProgram->object());
@@ -313,987 +504,961 @@ static void Render(GLuint baseInstance,int numFaces) {
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
 	glIndexPointer(GL_UNSIGNED_INT, 0, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferId);
 
-	// draw the VAO
-
-	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, numFaces * 3, GL_UNSIGNED_INT, 0, INUMVIEWS, baseInstance);
+	// draw the VAO, one instance per view of the page
+	for (int page = 0; page * layersPerPage < numEvalLayers; page++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, pageFbos[page]);
+		glClearColor(0, 0, 0, 1); // black
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (exactCount)
+		{
+			GLuint zero = 0;
+			glClearTexImage(pageFragmentCounts[page], 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+			glBindImageTexture(1, pageFragmentCounts[page], 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+		}
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)(pageCommands[page] * sizeof(DrawElementsIndirectCommand)),
+			pageCommands[page + 1] - pageCommands[page], 0);
+	}
 
 	// unbind the VAO
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
 	// unbind the program
 	glUseProgram(0);
 
-	// swap the display buffers (displays what was just drawn)
-	glfwSwapBuffers(gWindow);
-
-	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, ac_buffer);
-	GLuint userCounters[1];
-	glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), userCounters);
-	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
-	//std::cout << userCounters[0] << std::endl;
-	overdrawRatio();
-	//glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	// the window shows the first view
+	if (!offScreen)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, pageFbos[0]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, viewWidth, viewHeight, 0, 0, viewWidth, viewHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
 
-void OnError(int errorCode, const char* msg) {
-	throw std::runtime_error(msg);
+	// swap the display buffers (displays what was just drawn)
+	swapGLContext();
+
+	// the atomic counter is not read back here, glGetBufferSubData would wait for the draw
+	queueOverdrawReadback();
 }
 
-//function that implements the vcache optimization
-float FanVertLinSort(int *piIndexBufferIn, int *piIndexBufferOut, int iNumFaces, int *piScratch, int iCacheSize, int *piClustersOut, int &iNumClusters)
+// one color (and with exactCount one fragment count) texture array per page, with a layered depth attachment
+static void initViewPages()
 {
-	int i = 0;
-	int iNumFaces3 = iNumFaces * 3;
-	int sum = 0;
-	int lowi = 0;
-	int j = 0;
-	int next = -1;
-	int id;
-
-	iNumClusters = 1;
-	if (piClustersOut)
-		piClustersOut[0] = 0;
-
-	//set array pointers from scratch buffer
-	int *piEmitted = piScratch;
-	int *piFanList = piEmitted + iNumFaces;
-	int *piTriList = piFanList + iNumFaces3;
-
-	int *piStartList = piTriList + iNumFaces3;
-	int *piStartListTail = piStartList;
-
-	int *piRemValence = piStartList + iNumFaces3;
-
-	int *piCachePos = piRemValence + iNumFaces3;
-
-	int *piFanPos = piCachePos + iNumFaces3;
-
-
-	int iCurCachePos = 1 + iCacheSize; //so that cache position of 0 is out of cache
-	int iCurCachePosFan;
-
-	int nv = 0;
-	for (i = 0; i < iNumFaces3; i++)
-	{
-		register int ind = piIndexBufferIn[i];
-		piFanPos[ind]++;
-		if (piFanPos[ind] == 1)
-			piFanList[nv++] = ind;
-	}
-	for (i = 0; i < nv; i++)
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (maxPageLayers > 0)
+		maxLayers = min(maxLayers, maxPageLayers);
+	layersPerPage = min(numEvalLayers, maxLayers);
+	int numPages = (numEvalLayers + layersPerPage - 1) / layersPerPage;
+	pageColors.resize(numPages);
+	pageDepths.resize(numPages);
+	pageFbos.resize(numPages);
+	glGenTextures(numPages, &pageColors[0]);
+	glGenTextures(numPages, &pageDepths[0]);
+	glGenFramebuffers(numPages, &pageFbos[0]);
+	if (exactCount)
 	{
-		int x = piFanPos[piFanList[i]];
-		piRemValence[sum] = x;
-		sum = (piFanPos[piFanList[i]] += sum);
+		pageFragmentCounts.resize(numPages);
+		glGenTextures(numPages, &pageFragmentCounts[0]);
 	}
-	for (i = 0; i < iNumFaces3; i++)
-	{
-		piTriList[--piFanPos[piIndexBufferIn[i]]] = i;
-	}
-
-	i = 0;
-
-	//loop through extracting the triangles for the optimized buffer
-	while (lowi < iNumFaces3)
+	for (int page = 0; page < numPages; page++)
 	{
-		int bestemitted = -INT_MAX;
-		int tribest = -1;
-
-		//set current vertex id
-		id = piIndexBufferIn[piTriList[i]];
-
-		next = -1;
-
-		iCurCachePosFan = iCurCachePos;
-
-		//loop through extracting all faces from a vertex fan that were not previously written
-		while (i < iNumFaces3 && piIndexBufferIn[piTriList[i]] == id)
+		glBindTexture(GL_TEXTURE_2D_ARRAY, pageColors[page]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, viewWidth, viewHeight, pageViews(page));
+		glBindTexture(GL_TEXTURE_2D_ARRAY, pageDepths[page]);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, viewWidth, viewHeight, pageViews(page));
+		if (exactCount)
 		{
-			//get triangle id, and starting index of that triangle in original buffer (tri3)
-			int tri = piTriList[i] / 3;
-			int tri3 = tri * 3;
-
-			if (++piEmitted[tri] == 1)
-			{
-				int *pin = &piIndexBufferIn[tri3];
-				int ord = 0;
-				for (int ii = 0; ii < 3; ii++, pin++)
-				{
-					piIndexBufferOut[j++] = *pin;
-
-					int x = piFanPos[*pin];
-
-					int t = iCurCachePos - piCachePos[x] > iCacheSize;
-					if (t)
-					{
-						piCachePos[x] = iCurCachePos++;
-					}
-
-					int v = --piRemValence[x];
-					if (v > 0 && *pin != id)
-					{
-						if (t)
-						{
-							*(piStartListTail++) = *pin;
-						}
-						int f = cf(iCurCachePosFan, piCachePos[x], v);
-						if (f > bestemitted)
-						{
-							bestemitted = f;
-							next = *pin;
-						}
-					}
-				}
-			}
-
-			//increment counters into piTriList
-			if (i == lowi)
-				lowi++;
-			i++;
+			glBindTexture(GL_TEXTURE_2D_ARRAY, pageFragmentCounts[page]);
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32UI, viewWidth, viewHeight, pageViews(page));
 		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
-		//reset its fan position, so that it doesn't get processed twice
-		piFanPos[id] = 0;
-
-		if (next == -1)
-		{
-			int notfound = 1;
-
-			while (piStartListTail > piStartList)
-			{
-				i = piFanPos[*(--piStartListTail)];
-				if (i > 0)
-				{
-					notfound = 0;
-					break;
-				}
-			}
-
-			if (notfound)
-			{
-				while (lowi < iNumFaces3 && !piFanPos[piIndexBufferIn[piTriList[lowi]]])
-				{
-					lowi++;
-				}
-				i = lowi;
-			}
-
-			//overdraw output
-			if (piClustersOut && piClustersOut[iNumClusters - 1] != j / 3 && iCurCachePos - piCachePos[i] > iCacheSize * 2)
-			{
-				piClustersOut[iNumClusters++] = j / 3;
-			}
-		}
-		//if we have a neighboring id to fan around, set it as current
-		else
+		glBindFramebuffer(GL_FRAMEBUFFER, pageFbos[page]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pageColors[page], 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, pageDepths[page], 0);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
 		{
-			i = piFanPos[next];
+			std::cout << "framebuffer error:" << std::endl;
+			exit(EXIT_FAILURE);
 		}
 	}
-
-	//clear temp array (only the elements used)
-	for (i = 0; i < nv; i++)
-	{
-		piFanPos[piFanList[i]] = 0;
-	}
-	memset(piScratch, 0, (iNumFaces * 16) * sizeof(int));
-
-	if (piClustersOut && piClustersOut[iNumClusters - 1] == iNumFaces)
-		iNumClusters--;
-
-	return (iCurCachePos - iCacheSize - 1) / (float)iNumFaces;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-//function that implements the linear cutting
-int OverdrawOrderPartition(int *piIndexBufferIn,
-	int iNumFaces,
-	int *piClustersIn, //should have piClustersIn[iNumClusters] == iNumFaces
-	int iNumClustersIn,
-	int iCacheSize,
-	float lambda,
-	int *piClustersOut,
-	int *piScratch)
+static void deleteViewPages()
 {
-
-	int *piScratchBase = piScratch;
-	int *piCache = piScratch;
-	piScratch += iCacheSize;
-
-	int i;
-	int j = 0;
-
-	for (i = 0; i < iNumClustersIn; i++)
-	{
-		piClustersOut[j++] = piClustersIn[i];
-		int *p = piIndexBufferIn;
-		int n = piClustersIn[i + 1] - piClustersIn[i];
-		int start = piClustersIn[i];
-		int head = 0;
-		int m, k;
-		int iProc = 0;
-		for (m = 0; m < iCacheSize; m++)
-		{
-			piCache[m] = -1;
-		}
-		for (k = 0; k < n; k++, p += 3)
-		{
-			for (m = 0; m < 3; m++)
-			{
-				int found = 0;
-				for (int q = 0; q < iCacheSize; q++)
-				{
-					if (p[m] == piCache[q])
-					{
-						found = 1;
-						break;
-					}
-				}
-
-				if (!found)
-				{
-					iProc++;
-					piCache[head] = p[m];
-					head = (head + 1);
-					if (head == iCacheSize)
-						head = 0;
-				}
-			}
-
-			float fEstProc = iProc / (float)(k + 1);
-			if (k > 0 && lambda > fEstProc)
-			{
-				start += k;
-				piClustersOut[j++] = start;
-				n -= k;
-				k = -1;
-				p -= 3;
-				iProc = 0;
-				for (m = 0; m < iCacheSize; m++)
-				{
-					piCache[m] = -1;
-				}
-			}
-		}
-	}
-	piClustersOut[j] = iNumFaces;
-
-	memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
-
-	return j;
+	int numPages = (int)pageFbos.size();
+	glDeleteFramebuffers(numPages, &pageFbos[0]);
+	glDeleteTextures(numPages, &pageColors[0]);
+	glDeleteTextures(numPages, &pageDepths[0]);
+	if (exactCount)
+		glDeleteTextures(numPages, &pageFragmentCounts[0]);
+	pageFbos.clear();
+	pageColors.clear();
+	pageDepths.clear();
+	pageFragmentCounts.clear();
 }
 
-// function implements the linear sorting
-// output the linearFace(piIndexBufferOut), iNumColusters, piClustersOut (set patches)
-void FanVertCluster(float *pfVertexPositionsIn,   //vertex buffer positions, 3 floats per vertex
-	int *piIndexBufferIn,         //index buffer positions, 3 ints per vertex
-	int *piIndexBufferOut,        //updated index buffer (the output of the algorithm)
-	int iNumVertices,             //# of vertices in the vertex buffer
-	int iNumFaces,                //# of faces in the index buffer
-	int iCacheSize,               //hardware cache size
-	float alpha,                  //constant parameter to compute lambda term from algorithm 
-	int *piScratch = NULL,        //optional temp buffer for computations; its size in bytes should be:
-	int *piClustersOut = NULL,    //optional buffer for the output cluster position (in faces) of each cluster
-	int *piNumClustersOut = NULL) //the number of putput clusters
+// glewInit also loads the GLX extensions, which fails without an X display (an EGL context), so that error
+// is accepted; either way every GL 4.5 entry point the renderer calls must have resolved
+static bool glEntryPointsResolved()
 {
-	bool bMalloc = false;
-	if (piScratch == NULL)
-	{
-		int iScratchSize = FanVertScratchSize(iNumVertices, iNumFaces);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
-	}
-	int *piScratchBase = piScratch;
-
-	int *piIndexBufferTmp = piScratch;
-	piScratch += iNumFaces * 3;
-
-	int *piClustersIn = piScratch;
-	piScratch += iNumFaces + 1;
-
-	int *piClustersTmp = piScratch;
-	piScratch += iNumFaces + 1;
-
-	int *piClusterRemap = piScratch;
-	piScratch += iNumFaces + 1;
-
-
-	int iNumClusters;
-	float lambda = FanVertLinSort(piIndexBufferIn, piIndexBufferTmp, iNumFaces,
-		piScratch, iCacheSize, piClustersIn, iNumClusters);
-
-	lambda = alpha;
-
-	int iNumClustersOut = OverdrawOrderPartition(piIndexBufferTmp, iNumFaces,
-		piClustersIn, iNumClusters, iCacheSize, lambda, piClustersTmp, piScratch);
-
-	if (piNumClustersOut != NULL){
-		*piNumClustersOut = iNumClustersOut;
-	}
-	if (piClustersTmp[iNumClustersOut] != iNumFaces)
-	{
-		printf("DOH\n");
-	}
+	return glGenVertexArrays != NULL && glGenBuffers != NULL && glMapBufferRange != NULL && glFenceSync != NULL
+		&& glTexStorage3D != NULL && glFramebufferTexture != NULL && glVertexAttribIPointer != NULL && glVertexAttribDivisor != NULL
+		&& glMultiDrawElementsIndirect != NULL && glBindImageTexture != NULL && glMemoryBarrier != NULL
+		&& glDispatchCompute != NULL && glClearTexImage != NULL && glGetTextureImage != NULL;
+}
 
-	for (int i = 0; i < iNumFaces * 3; i++)
-	{
-		piIndexBufferOut[i] = piIndexBufferTmp[i];
-	}
-	for (int i = 0; i < iNumClustersOut + 1; i++)
+static bool initGLEW()
+{
+	glewExperimental = GL_TRUE; //stops glew crashing on OSX :-/
+	GLenum err = glewInit();
+#if defined(GLEW_ERROR_NO_GLX_DISPLAY)
+	bool noDisplay = (err == GLEW_ERROR_NO_GLX_DISPLAY);
+#else
+	bool noDisplay = (err == GLEW_ERROR_GLX_VERSION_11_ONLY);
+#endif
+	if (err != GLEW_OK && !noDisplay)
 	{
-		piClustersOut[i] = piClustersTmp[i];
+		fprintf(stderr, "ERROR: %s\n", glewGetErrorString(err));
+		return false;
 	}
-	if (piScratch - piScratchBase > 0)
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int)); //clear memory from tmp
-	if (bMalloc)
+	if (!glEntryPointsResolved())
 	{
-		free(piScratchBase);
+		fprintf(stderr, "ERROR: the GL 4.5 entry points could not be loaded\n");
+		return false;
 	}
+	return true;
 }
 
-//function that implements getting patches positions
-void pvPatchesPostions(int *piIndexBufferIn,
-	int iNumFaces,
-	float *pfVertexPositionsIn,
-	int iNumVertices,
-	int *piClustersIn,
-	int iNumClusters,
-	Vector * pvPatchesPositions,
-	int *piScratch
-	)
+// makes the context and everything the evaluation of the numMeans index buffers piMeanIndexBuffers (numFaces faces
+// each, NULL to upload them later) in numViews views needs, at viewWidth x viewHeight; throws without a GL 4.5
+// context. The context is current on the calling thread afterwards
+static void initGLEvaluation(float * pfCameraPosiitons, int numViews, int * piMeanIndexBuffers, int numMeans, int numVertices, int numFaces)
 {
-	int i, j;
-	int c = 0, cstart = 0;
-	int cnext = piClustersIn[1];
-	int *p = piIndexBufferIn;
-	Vector *pvVertexPositionsIn = (Vector *)pfVertexPositionsIn;
-	Vector vMeshPositions = Vector(0, 0, 0);
-	float fMArea = 0.f;
-
-	bool bMalloc = false;
-	if (piScratch == NULL)
+	numEvalViews = numViews;
+	numEvalMeans = numMeans;
+	numEvalLayers = numViews * numMeans;
+
+	if (contextBackend == GLCONTEXT_EGL)
+		offScreen = true;
+	if (!createGLContext(contextBackend, viewWidth, viewHeight, !offScreen))
+		throw std::runtime_error("no GL 4.5 context");
+	// initialise GLEW
+	if (!initGLEW())
 	{
-		int iScratchSize = FanVertScratchSize(iNumVertices, iNumFaces);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
+		destroyGLContext();
+		throw std::runtime_error("glewInit failed");
 	}
-	int *piScratchBase = piScratch;
-	Vector *pvClusterPositions = (Vector *)piScratch;
-	piScratch += iNumClusters * 3;
-
-	Vector *pvClusterNormals = (Vector *)piScratch;
-	piScratch += iNumClusters * 3;
-
-	float *pfClusterAreas = (float *)piScratch;
-	piScratch += iNumClusters;
-
-	for (i = 0; i < iNumClusters; i++)
+		
+	if (exactCount && !gpuReduce)
 	{
-		pvClusterPositions[i] = Vector(0, 0, 0);
-		pvClusterNormals[i] = Vector(0, 0, 0);
+		printf("exact counting reduces on the GPU, gpuReduce is turned on\n");
+		gpuReduce = true;
 	}
-	float fCArea = 0.f;
-
-	for (i = 0; i <= iNumFaces; i++)
-	{
-		if (i == cnext)
-		{
-			pfClusterAreas[c] = fCArea;
-			pvClusterPositions[c] /= fCArea * 3.f;
-			pvClusterNormals[c].normalize();
-			c++;
-			if (c == iNumClusters)
-				break;
-			cstart = i;
-			cnext = piClustersIn[c + 1];
-			fCArea = 0.f;
-		}
+	initViewPages();
+	initReadbackRing();
 
-		Vector vNormal = cross(pvVertexPositionsIn[p[2]] - pvVertexPositionsIn[p[0]],
-			pvVertexPositionsIn[p[1]] - pvVertexPositionsIn[p[0]]);
-		float fArea = vNormal.length();
-		if (fArea > 0.f)
-		{
-			vNormal /= fArea;
-		}
-		else
-		{
-			fArea = 0.f;
-			vNormal = Vector(0, 0, 0);
-		}
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE,GL_ONE);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE);
+	// load vertex and fragment shaders into opengl
+	LoadShaders();
 
-		for (j = 0; j < 3; j++)
-		{
-			Vector *vp = (Vector *)&pfVertexPositionsIn[(*p) * 3];
-			vMeshPositions += *vp * fArea;
-			pvClusterPositions[c] += *vp * fArea;
-			p++;
-		}
+	atomicCounterArray[0] = 0;
+	glGenBuffers(1, &ac_buffer);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, ac_buffer);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, ac_buffer);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
 
-		pvClusterNormals[c] += vNormal;
+	LoadTriangle(pfCameraPosiitons, piMeanIndexBuffers, numMeans, numVertices, numFaces);
+	glViewport(0, 0, viewWidth, viewHeight);
+}
 
-		fMArea += fArea;
-		fCArea += fArea;
-	}
-	vMeshPositions /= fMArea * 3.f;
-	for (int i = 0; i < iNumClusters; i++){
-		pvPatchesPositions[i] = Vector(pvClusterPositions[i].v[0], pvClusterPositions[i].v[1], pvClusterPositions[i].v[2]);
-	}
-	
-	if (piScratch - piScratchBase > 0)
-	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
-	}
-	if (bMalloc)
-	{
-		free(piScratchBase);
-	}
+// waits for the last readbacks and frees what initGLEvaluation made, with the context
+static void finishGLEvaluation()
+{
+	drainOverdrawReadbacks();
+	UnloadTriangle();
+	glDeleteBuffers(1, &ac_buffer);
+	glDeleteBuffers(PBORINGSIZE, pixelBuffers);
+	deleteViewPages();
+	delete gProgram;
+	delete gReduceProgram;
+	gProgram = NULL;
+	gReduceProgram = NULL;
+	destroyGLContext();
 }
 
-// function that implements rank faces from near to far
-void depthSortPatch(Vector viewpoint, Vector * pvAvgPatchesPositions, int numPatches, int *piIndexBufferIn, int *piClustersIn, int * piIndexBufferTmp)
+// the program starts here
+// means are patch permutations of the clustered piIndexBufferIn, expanded to index data just before upload; the
+// numViews views of each of the numFrames frames are rendered at viewWidth x viewHeight, offScreen only hides the window
+void AppMain(float ** pfVertexPositionsIn, int numFrames, float * pfCameraPosiitons, int numViews, PatchId ** means, int numMeans, int numPatches, int * piIndexBufferIn, int * piClustersIn, int numVertices, int numFaces)
 {
-	//std::cout << "linear sort face"<<piIndexBufferIn[0] << " "<<piIndexBufferIn[1] << " "<< piIndexBufferIn[2] << std::endl;
-	//std::cout << "linear sort face" << piIndexBufferIn[INUMFACES*3-3] << " " << piIndexBufferIn[INUMFACES*3-2] << " " << piIndexBufferIn[INUMFACES*3-1] << std::endl;
-	//std::cout << " patch Id" << piClustersIn[0] << " "<< piClustersIn[numPatches] << std::endl;
-	int i, j;
-	int * piScratch = NULL;
-	bool bMalloc = false;
-	if (piScratch == NULL)
+	int * piMeanIndexBuffers = (int *)malloc((size_t)numMeans * numFaces * 3 * sizeof(int));
+	for (int j = 0; j < numMeans; j++)
+		expandPatchOrder(means[j], numPatches, piIndexBufferIn, piClustersIn, piMeanIndexBuffers + (size_t)j * numFaces * 3);
+	try
 	{
-		int iScratchSize = numPatches * 2 * sizeof(int);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
+		initGLEvaluation(pfCameraPosiitons, numViews, piMeanIndexBuffers, numMeans, numVertices, numFaces);
 	}
-	int *piScratchBase = piScratch;
-	patchSort *viewToPatch = (patchSort *)piScratch;
-	piScratch += numPatches * 2;
-
-	for (i = 0; i < numPatches; i++)
+	catch (...)
 	{
-		viewToPatch[i].id = i;
-		viewToPatch[i].dist = dist(viewpoint, pvAvgPatchesPositions[i]);
+		free(piMeanIndexBuffers);
+		throw;
 	}
-	std::sort(viewToPatch, viewToPatch + numPatches, sortfunc);
-	//std::cout << viewToPatch[0].dist << " " << viewToPatch[1].dist << " " << viewToPatch[2].dist << std::endl;
-
-	int jj = 0;
-	for (i = 0; i < numPatches; i++)
+	for (int i = 0; i < numFrames; i++)
 	{
-		for (j = piClustersIn[viewToPatch[i].id] * 3; j < piClustersIn[viewToPatch[i].id + 1] * 3; j++)
-		{
-			piIndexBufferTmp[jj++] = piIndexBufferIn[j];
-		}
+		LoadFrame(pfVertexPositionsIn[i], numVertices);
+		Render();
 	}
-	//std::cout << " means[0][0] " << piIndexBufferTmp[0] << " " << piIndexBufferTmp[1] << " " << piIndexBufferTmp[2] << std::endl;
-	//std::cout << "means[0][inumFaces] " << piIndexBufferTmp[INUMFACES * 3 - 3] << " " << piIndexBufferTmp[INUMFACES * 3 - 2] << " " << piIndexBufferTmp[INUMFACES * 3 - 1] << std::endl;
+	finishGLEvaluation();
+	free(piMeanIndexBuffers);
+}
+
+// GL OrderingEvaluator: the exact R32UI counts of the GPU path as the ratio of an ordering at (frame, view) pairs
+struct GLEvaluator
+{
+	float **pfFramesVertexPositions;
+	int numFrames;
+	int numViews;
+	int numVertices;
+	int numFaces;
+	int numPatches;
+	const int *piIndexBuffer;
+	const int *piClusters;
+	std::vector<int> meanIndexBuffer;
+	bool savedExactCount;
+	bool savedGpuReduce;
+	// the evaluator is called from the pool threads, they take turns on the one context
+	std::mutex mutex;
+};
 
-	if (piScratch - piScratchBase > 0)
+// makes the context with the exact counts for one ordering of numFaces faces at a time and releases it from the
+// calling thread; throws without a GL 4.5 context. Only one GLEvaluator can exist at a time
+static void beginGLEvaluator(GLEvaluator *evaluator, float **pfFramesVertexPositions, int numFrames, float *pfCameraPositions, int numViews,
+	const int *piIndexBufferIn, const int *piClustersIn, int numPatches, int numVertices, int numFaces)
+{
+	evaluator->pfFramesVertexPositions = pfFramesVertexPositions;
+	evaluator->numFrames = numFrames;
+	evaluator->numViews = numViews;
+	evaluator->numVertices = numVertices;
+	evaluator->numFaces = numFaces;
+	evaluator->numPatches = numPatches;
+	evaluator->piIndexBuffer = piIndexBufferIn;
+	evaluator->piClusters = piClustersIn;
+	evaluator->meanIndexBuffer.resize(numFaces * 3);
+	evaluator->savedExactCount = exactCount;
+	evaluator->savedGpuReduce = gpuReduce;
+	exactCount = true;
+	gpuReduce = true;
+	try
 	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+		initGLEvaluation(pfCameraPositions, numViews, NULL, 1, numVertices, numFaces);
 	}
-	if (bMalloc)
+	catch (...)
 	{
-		free(piScratchBase);
+		exactCount = evaluator->savedExactCount;
+		gpuReduce = evaluator->savedGpuReduce;
+		throw;
 	}
+	bindGLContext(false);
 }
-// function that implements the initializition
-void initMeans(int ** means, Vector ** pvFramesPatchesPositions, int * piIndexBufferIn, int * piClustersIn, int numFrames, int numClusters, int numPatches, int numFaces, int * pickIds, float * pfCameraPositions, int * piScratch)
+
+// every frame the members use is rendered once with all views in one multi draw, in member order, and the
+// ratios of the member views are taken from its readback; an empty view is 0 like patchOrderRatio
+static void glOrderingRatios(GLEvaluator *evaluator, const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios)
 {
-	int i, j;
-	bool bMalloc = false;
-	if (piScratch == NULL)
-	{
-		int iScratchSize = numPatches * 3 * sizeof(int) + numFaces * 3 * sizeof(int);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
-	}
-	int *piScratchBase = piScratch;
-	Vector *pvAvgPatchesPositions = (Vector *)piScratch;
-	piScratch += numPatches * 3;
-	int *piIndexBufferTmp = piScratch;
-	piScratch += numFaces * 3;
+	std::unique_lock<std::mutex> lock(evaluator->mutex);
+	bindGLContext(true);
+	expandPatchOrder(pusPatchOrder, evaluator->numPatches, evaluator->piIndexBuffer, evaluator->piClusters, &evaluator->meanIndexBuffer[0]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, evaluator->meanIndexBuffer.size() * sizeof(int), &evaluator->meanIndexBuffer[0]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	for (i = 0; i < numFrames; i++)
+	std::vector<int> frameSlots(evaluator->numFrames, -1);
+	std::vector<int> frames;
+	for (int i = 0; i < numMembers; i++)
 	{
-		for (j = 0; j < numPatches; j++)
+		if (frameSlots[members[i].frameId] == -1)
 		{
-			pvAvgPatchesPositions[j] += pvFramesPatchesPositions[i][j];
+			frameSlots[members[i].frameId] = (int)frames.size();
+			frames.push_back(members[i].frameId);
 		}
 	}
-	for (j = 0; j < numPatches; j++)
-	{
-		pvAvgPatchesPositions[j] /= numFrames;
-	}
-
-	for (i = 0; i < numClusters; i++)
-	{
-		Vector viewpoint = Vector(pfCameraPositions[pickIds[i] * 3], pfCameraPositions[pickIds[i] * 3 + 1], pfCameraPositions[pickIds[i] * 3 + 2]);
-		depthSortPatch(viewpoint, pvAvgPatchesPositions, numPatches, piIndexBufferIn, piClustersIn, means[i]);
-	}
-	if (piScratch - piScratchBase > 0)
+	std::vector<float> ratios;
+	pEvalRatios = &ratios;
+	for (size_t i = 0; i < frames.size(); i++)
 	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+		LoadFrame(evaluator->pfFramesVertexPositions[frames[i]], evaluator->numVertices);
+		Render();
 	}
-	if (bMalloc)
+	drainOverdrawReadbacks();
+	pEvalRatios = NULL;
+	for (int i = 0; i < numMembers; i++)
 	{
-		free(piScratchBase);
+		float ratio = ratios[(size_t)frameSlots[members[i].frameId] * evaluator->numViews + members[i].viewId];
+		pfRatios[i] = ratio == ratio ? ratio : 0.f;
 	}
+	bindGLContext(false);
+}
+
+static void endGLEvaluator(GLEvaluator *evaluator)
+{
+	bindGLContext(true);
+	finishGLEvaluation();
+	evaluator->meanIndexBuffer.clear();
+	exactCount = evaluator->savedExactCount;
+	gpuReduce = evaluator->savedGpuReduce;
 }
 
-//function that implements converting assignments to clusterAssignments
+// runs cleanup when it goes out of scope
+struct ScopeCleanup
+{
+	std::function<void()> cleanup;
+	~ScopeCleanup() { cleanup(); }
+};
 
-// function that implements the assignments
-void makeAssignment(float ** assignments, float ** minRatios, int numFrames, int numViews, int numClusters, int *piScratch)
+// clusters the views of one animation of the dataset and writes its orderings to <vfFolder>orderings.vfo
+int processAnimation(const DatasetEntry *entry, ThreadPool &pool)
 {
-	//float assignments[INUMFRAMES][INUMVIEWS], float minRatios[INUMFRAMES][INUMVIEWS]
-	int x, y,z;
+	// parameters needed
+	float alpha = 0.85; int iCacheSize = 20;
+	int numFrames = entry->numFrames; int iNumVertices = entry->iNumVertices; int iNumFaces = entry->iNumFaces; int numPatches = 0; int numViews = entry->numViews;
+	int numClusters = 5; std::vector<int> pickIds(numClusters);
+	// rays per view of rayReport and rayEvaluate
+	int rayReportRays = 256;
+	// limits of the Lloyd clustering
+	int lloydIterations = 50; double lloydSeconds = 600;
+	// batches of the mini-batch clustering, from miniBatchSize growing by miniBatchGrowth up to miniBatchMax pairs
+	int miniBatchSize = 256; int miniBatchMax = 16384; float miniBatchGrowth = 1.5f;
+	// range and stop rules of autoClusters
+	int maxClusters = 12; float targetOverdraw = 1.05f; long long indexByteBudget = 0;
+	if (autoClusters)
+		pickIds.resize(max(numClusters, maxClusters));
+	if (streamFrames && (occlusionMeans || rayReport || rayEvaluate || glEvaluate || lloyd || miniBatch || autoClusters))
+	{
+		jobPrintf("ERROR: occlusionMeans, rayReport, rayEvaluate, glEvaluate, lloyd, miniBatch and autoClusters need the frames in memory; "
+			"with -streamFrames pass -noLloyd and none of the others\n");
+		return EXIT_FAILURE;
+	}
+
+	// set memory
+	int * miScratch = NULL;
 	bool bMalloc = false;
-	if (piScratch == NULL)
+	if (miScratch == NULL)
 	{
-		int iScratchSize = numFrames*numClusters*numViews * sizeof(int);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
+		int iScratchSize =  (iNumFaces* 3*2) * sizeof(int);
+		miScratch = (int *)malloc(iScratchSize);
+		memset(miScratch, 0, iScratchSize);
 		bMalloc = true;
 	}
-	int *piScratchBase = piScratch;
-	float * ratios = (float * ) piScratch;
-	piScratch += numFrames*numClusters*numViews;
+	int *piScratchBase = miScratch;
+	int * piIndexBufferOut = miScratch;
+	miScratch += iNumFaces * 3;
+	int * piClustersOut = miScratch;
+	miScratch += iNumFaces * 3;
 	
-	//float ratios[INUMFRAMES][INUMCLUSTERS][INUMVIEWS];
-	// numframes depth, numClusters width, numViews height
-
-	// test the sort
-	// makeup the part for compute ovr in opengl
+	// sized once FanVertCluster has given the number of patches
+	Vector ** pvFramesPatchesPositions = NULL;
+	PatchId ** means = NULL;
+	//int means[5][INUMFACES * 3];
+	time_t tstart, tend;
 
-	// 3 dimension array 
+	
+	//int piIndexBufferOut[INUMFACES * 3];
+	//int piClustersOut[INUMFACES * 3];
+	//Vector  pvFramesPatchesPositions[numFrames][482];
 
-	patchSort tempRatio[INUMCLUSTERS];
-	for ( x= 0; x < numFrames; x++) 
+	int *piScratch = NULL; int iNumClusters;
+	const char *vfFolder = entry->vfFolder; char cachePath[400];
+	std::cout << entry->character << "/" << entry->animation << ": " << iNumVertices << " vertices, " << iNumFaces << " faces, "
+		<< numFrames << " frames, " << numViews << " views" << std::endl;
+
+	AnimationCache animCache;
+	memset(&animCache, 0, sizeof(animCache));
+	SkinnedMesh skinnedMesh;
+	memset(&skinnedMesh, 0, sizeof(skinnedMesh));
+	bool skinnedFrames = hasSkinnedMesh(vfFolder);
+	int * piIndexBufferIn = NULL;
+	float * pfCameraPositions = NULL;
+	float ** pfFramesVertexPositionsIn = NULL;
+	float * pfFirstFrame = NULL;
+	// every return frees what was allocated up to there
+	ScopeCleanup cleanup = { [&]() {
+		if (streamFrames || skinnedFrames)
+		{
+			free(piIndexBufferIn);
+			freeSkinnedMesh(&skinnedMesh);
+			delete_Array2D(pfFramesVertexPositionsIn, numFrames, iNumVertices * 3);
+		}
+		else
+		{
+			closeAnimationCache(&animCache);
+		}
+		delete_Array2D(means, (int)pickIds.size(), numPatches);
+		delete_Array2D(pvFramesPatchesPositions, numFrames, numPatches);
+		if (bMalloc)
+		{
+			free(piScratchBase);
+		}
+	} };
+	if (streamFrames || skinnedFrames)
 	{
-		for (z = 0; z < numViews; z++)
+		// only the faces, the viewpoints and the first frame (for the clustering) are loaded up front;
+		// frames come either from the frame<N>v.txt files or are skinned on demand
+		char path[400];
+		piIndexBufferIn = (int *)malloc((iNumFaces * 3 + numViews * 3 + iNumVertices * 3) * sizeof(int));
+		pfCameraPositions = (float *)(piIndexBufferIn + iNumFaces * 3);
+		pfFirstFrame = pfCameraPositions + numViews * 3;
+		strcpy(path, vfFolder);
+		strcat(path, "face.txt");
+		bool ok = loadTextInts(path, piIndexBufferIn, iNumFaces * 3, &pool);
+		strcpy(path, vfFolder);
+		strcat(path, "newViewpoint3.txt");
+		ok = ok && loadTextFloats(path, pfCameraPositions, numViews * 3, &pool);
+		if (skinnedFrames)
+			ok = ok && loadSkinnedMesh(vfFolder, iNumVertices, numFrames, &skinnedMesh, &pool);
+		std::function<bool(int, float *)> loadFrame = [&](int frameId, float *pfOut) -> bool {
+			if (skinnedFrames)
+			{
+				skinFrames(&skinnedMesh, frameId, 1, &pfOut, NULL);
+				return true;
+			}
+			return loadTextFrames(vfFolder, frameId, 1, &pfOut, iNumVertices, NULL);
+		};
+		ok = ok && loadFrame(0, pfFirstFrame);
+		if (!ok)
+			return EXIT_FAILURE;
+		FanVertCluster(pfFirstFrame, piIndexBufferIn, piIndexBufferOut, iNumVertices, iNumFaces, iCacheSize, alpha, piScratch, piClustersOut, &iNumClusters);
+		numPatches = iNumClusters;
+		pvFramesPatchesPositions = new_Array2D<Vector>(numFrames, numPatches);
+		if (streamFrames)
+		{
+			if (!streamPatchesPositions(loadFrame, numFrames, iNumVertices, piIndexBufferOut, iNumFaces, piClustersOut, iNumClusters, pvFramesPatchesPositions, &pool))
+				return EXIT_FAILURE;
+		}
+		else
 		{
-			for (int y = 0; y < numClusters; y++)
+			pfFramesVertexPositionsIn = new_Array2D<float>(numFrames, iNumVertices * 3);
+			skinFrames(&skinnedMesh, 0, numFrames, pfFramesVertexPositionsIn, &pool);
+			for (int i = 0; i < numFrames; i++)
 			{
-				tempRatio[y].id = y;
-				//tempRatio[k].id = ratios[i][k][j];
-				tempRatio[y].id = ratios[x + numClusters * (y + numFrames * z)];
+				pvPatchesPostions(piIndexBufferOut, iNumFaces, pfFramesVertexPositionsIn[i], iNumVertices, piClustersOut, iNumClusters, pvFramesPatchesPositions[i], piScratch);
 			}
-			std::sort(tempRatio, tempRatio + numClusters, sortfunc);
-			minRatios[x][z] = tempRatio[0].dist;
-			assignments[x][z] = tempRatio[0].id;
 		}
 	}
+	else
+	{
+		// faces, viewpoints and frames come from the binary cache, converted from the text files on the first run
+		strcpy(cachePath, vfFolder);
+		strcat(cachePath, ANIMCACHEFILE);
+		std::cout << cachePath << std::endl;
+		bool opened = openAnimationCache(cachePath, &animCache);
+		// a cache converted from older text files is rebuilt (the entry then has the counts of the text files)
+		if (opened && animationCacheIsStale(animCache.pHeader, vfFolder))
+		{
+			closeAnimationCache(&animCache);
+			opened = false;
+		}
+		if (!opened)
+		{
+			if (!convertAnimationFolder(vfFolder, cachePath, iNumVertices, iNumFaces, numFrames, numViews, &pool) || !openAnimationCache(cachePath, &animCache))
+			{
+				jobPrintf("ERROR: animation cache cannot be opened\n");
+				return EXIT_FAILURE;
+			}
+		}
+		piIndexBufferIn = animCache.piIndexBuffer;
+		pfCameraPositions = animCache.pfCameraPositions;
+		pfFramesVertexPositionsIn = animCache.pfFramesVertexPositions;
+
+		FanVertCluster(pfFramesVertexPositionsIn[0], piIndexBufferIn, piIndexBufferOut, iNumVertices, iNumFaces, iCacheSize, alpha, piScratch, piClustersOut, &iNumClusters);
+		numPatches = iNumClusters;
+		pvFramesPatchesPositions = new_Array2D<Vector>(numFrames, numPatches);
 
-	if (piScratch - piScratchBase > 0)
+		for (int i = 0; i < numFrames; i++)
+		{
+			pvPatchesPostions(piIndexBufferOut, iNumFaces, pfFramesVertexPositionsIn[i], iNumVertices, piClustersOut, iNumClusters, pvFramesPatchesPositions[i], piScratch);
+		}
+	}
+	Vector *pvCameraPositions = (Vector *)pfCameraPositions;
+	if (numPatches > MAXPATCHES)
 	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+		jobPrintf("ERROR: clustering gave %d patches, at most %d are supported\n", numPatches, MAXPATCHES);
+		return EXIT_FAILURE;
 	}
-	if (bMalloc)
+	means = new_Array2D<PatchId>((int)pickIds.size(), numPatches);
+	if (vcacheReport)
 	{
-		free(piScratchBase);
+		const char *names[2] = { "input", "fanvert" };
+		const int *piIndexBuffers[2] = { piIndexBufferIn, piIndexBufferOut };
+		printVCacheReport(names, piIndexBuffers, 2, iNumFaces, iNumVertices);
 	}
-}
 
-float newClusterRatio()
-{
-	return 0.0;
-}
-// moveClusterMean
-bool moveClusterMean(int *clusterMean, int clusterId, int* piIndexBufferIn, int * piClustersIn, Vector ** pvFramesPatchesPositions, Vector * pvCameraPosiitons, int ** assignments, float ** minRatios, int numPatches, int numViews, int numFrames,int numFaces, int *piScratch)
-{
-	int i, j;
-	bool bMalloc = false;
-	bool moved = false;
-	if (piScratch == NULL)
+	// the exact patch coverage of all frames and views, built on first use and shared by the passes below
+	CoverageCache coverage;
+	bool coverageBuilt = false;
+	std::function<const CoverageCache *()> exactCoverage = [&]() -> const CoverageCache * {
+		if (!coverageBuilt)
+		{
+			buildCoverageCache(pfFramesVertexPositionsIn, numFrames, iNumVertices, piIndexBufferOut, piClustersOut, numPatches, iNumFaces,
+				pfCameraPositions, numViews, CANVASWIDTH, CANVASHEIGHT, &coverage, &pool);
+			coverageBuilt = true;
+		}
+		return &coverage;
+	};
+	// the ray samples of all frames and views, built on first use like the exact coverage
+	CoverageCache rays;
+	bool raysBuilt = false;
+	std::function<const CoverageCache *()> rayCoverage = [&]() -> const CoverageCache * {
+		if (!raysBuilt)
+		{
+			buildRayCache(pfFramesVertexPositionsIn, numFrames, piIndexBufferOut, piClustersOut, numPatches, iNumFaces, pfCameraPositions,
+				numViews, (float)CANVASWIDTH / CANVASHEIGHT, rayReportRays, &rays, &pool);
+			raysBuilt = true;
+		}
+		return &rays;
+	};
+
+	// start point
+	tstart = time(0);
+	seedViews(pvFramesPatchesPositions, numFrames, numPatches, pfCameraPositions, numViews, numClusters, numClusters, 1, &pickIds[0], &pool);
+	initMeans(means, pvFramesPatchesPositions, numFrames, numClusters, numPatches, &pickIds[0], pfCameraPositions, piScratch);
+	if (occlusionMeans)
 	{
-		int iScratchSize = (numFrames*numViews * 2 + numPatches * 2+numFaces*3)* sizeof(int);
-		piScratch = (int *)malloc(iScratchSize);
-		memset(piScratch, 0, iScratchSize);
-		bMalloc = true;
+		OcclusionGraphCache graphs;
+		buildOcclusionGraphCache(exactCoverage(), &graphs, &pool);
+		std::vector<clusterAssign> members(numFrames);
+		std::vector<PatchId> distanceOrder(numPatches);
+		for (int i = 0; i < numClusters; i++)
+		{
+			for (int frameId = 0; frameId < numFrames; frameId++)
+			{
+				members[frameId].frameId = frameId;
+				members[frameId].viewId = pickIds[i];
+			}
+			memcpy(&distanceOrder[0], means[i], numPatches * sizeof(PatchId));
+			occlusionOrder(&graphs, &members[0], numFrames, &distanceOrder[0], means[i]);
+			float before = 0.f, after = 0.f;
+			for (int frameId = 0; frameId < numFrames; frameId++)
+			{
+				before += patchOrderRatio(coverageAt(exactCoverage(), frameId, pickIds[i]), &distanceOrder[0]) / numFrames;
+				after += patchOrderRatio(coverageAt(exactCoverage(), frameId, pickIds[i]), means[i]) / numFrames;
+			}
+			std::cout << "cluster " << i << " (view " << pickIds[i] << "): overdraw " << before << " by distance, " << after << " by occlusion" << std::endl;
+		}
 	}
-	int *piScratchBase = piScratch;
-	clusterAssign * cluster = (clusterAssign*)piScratch;
-	piScratch += 2 * numFrames*numViews;
-	patchSort * viewToPatch = (patchSort *)piScratch;
-	piScratch += numPatches * 2;
-	int * newMean = piScratch;
-	piScratch += numFaces * 3;
-
-	int count = 0; float avgRatio = 0;
-	for (i = 0; i < numFrames; i++)
+	if (lloyd || miniBatch || autoClusters)
 	{
-		for (j = 0; j < numViews; j++)
+		// the mini-batch clustering rasterizes its pairs on demand, unless the whole cache is there already
+		LazyCoverageCache lazyCoverage;
+		GLEvaluator glEvaluator;
+		OrderingEvaluator evaluate;
+		if (glEvaluate)
 		{
-			if (assignments[i][j] == clusterId)
+			try
+			{
+				beginGLEvaluator(&glEvaluator, pfFramesVertexPositionsIn, numFrames, pfCameraPositions, numViews, piIndexBufferOut, piClustersOut,
+					numPatches, iNumVertices, iNumFaces);
+			}
+			catch (const std::exception &e)
 			{
-				
-				cluster[count].frameId = i;
-				cluster[count].viewId = j;
-				avgRatio += minRatios[i][j];
-				count++;
+				jobPrintf("ERROR: %s\n", e.what());
+				return EXIT_FAILURE;
 			}
+			evaluate = [&](const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios) {
+				glOrderingRatios(&glEvaluator, pusPatchOrder, members, numMembers, pfRatios);
+			};
+		}
+		else if (rayEvaluate)
+		{
+			const CoverageCache *pRays = rayCoverage();
+			evaluate = [=, &pool](const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios) {
+				coverageRatios(pRays, pusPatchOrder, members, numMembers, pfRatios, &pool);
+			};
+		}
+		else if (miniBatch && !autoClusters && !coverageBuilt)
+		{
+			initLazyCoverageCache(pfFramesVertexPositionsIn, numFrames, iNumVertices, piIndexBufferOut, piClustersOut, numPatches, iNumFaces,
+				pfCameraPositions, numViews, CANVASWIDTH, CANVASHEIGHT, miniBatchMax, &lazyCoverage);
+			evaluate = [&](const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios) {
+				lazyCoverageRatios(&lazyCoverage, pusPatchOrder, members, numMembers, pfRatios, &pool);
+			};
+		}
+		else
+		{
+			const CoverageCache *pCoverage = exactCoverage();
+			evaluate = [=, &pool](const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios) {
+				coverageRatios(pCoverage, pusPatchOrder, members, numMembers, pfRatios, &pool);
+			};
+		}
+		int **assignments = new_Array2D<int>(numFrames, numViews);
+		float **minRatios = new_Array2D<float>(numFrames, numViews);
+		if (autoClusters)
+		{
+			int chosen = chooseNumClusters(means, &pickIds[0], maxClusters, targetOverdraw, (long long)iNumFaces * 3 * sizeof(int), indexByteBudget,
+				numPatches, pvFramesPatchesPositions, pfCameraPositions, pvCameraPositions, numFrames, numViews, evaluate, lloydIterations, lloydSeconds,
+				assignments, minRatios, NULL, &pool);
+			if (chosen > 0)
+				numClusters = chosen;
 		}
+		else if (miniBatch)
+		{
+			clusterMeansMiniBatch(means, numClusters, numPatches, pvFramesPatchesPositions, pvCameraPositions, numFrames, numViews, evaluate,
+				miniBatchSize, miniBatchMax, miniBatchGrowth, lloydIterations, lloydSeconds, 1, assignments, minRatios, &pool);
+			if (!glEvaluate && !rayEvaluate && !coverageBuilt)
+				std::cout << lazyCoverage.numBuilt << " of " << numFrames * numViews << " (frame, view) pairs rasterized" << std::endl;
+		}
+		else
+			clusterMeans(means, numClusters, numPatches, pvFramesPatchesPositions, pvCameraPositions, numFrames, numViews, evaluate,
+				lloydIterations, lloydSeconds, assignments, minRatios, &pool);
+		if (glEvaluate)
+			endGLEvaluator(&glEvaluator);
+		delete_Array2D(minRatios, numFrames, numViews);
+		delete_Array2D(assignments, numFrames, numViews);
 	}
-	avgRatio /= count;
-
-	int frameId, viewId;
-	for (i = 0; i < numPatches; i++)
+	if (overdrawReport)
 	{
-		viewToPatch[i].id = i;
+		std::vector<std::string> meanNames(numClusters);
+		std::vector<const char *> names(2 + numClusters);
+		std::vector<const int *> piIndexBuffers(2 + numClusters);
+		names[0] = "input"; piIndexBuffers[0] = piIndexBufferIn;
+		names[1] = "fanvert"; piIndexBuffers[1] = piIndexBufferOut;
+		int *piMeanIndexBuffers = (int *)malloc(numClusters * iNumFaces * 3 * sizeof(int));
+		for (int i = 0; i < numClusters; i++)
+		{
+			meanNames[i] = "cluster " + std::to_string(i);
+			names[2 + i] = meanNames[i].c_str();
+			expandPatchOrder(means[i], numPatches, piIndexBufferOut, piClustersOut, piMeanIndexBuffers + i * iNumFaces * 3);
+			piIndexBuffers[2 + i] = piMeanIndexBuffers + i * iNumFaces * 3;
+		}
+		if (pfFramesVertexPositionsIn != NULL)
+			printOverdrawReport(&names[0], &piIndexBuffers[0], 2 + numClusters, iNumFaces, pfFramesVertexPositionsIn, numFrames, iNumVertices, pfCameraPositions, numViews, CANVASWIDTH, CANVASHEIGHT, &pool);
+		else
+			printOverdrawReport(&names[0], &piIndexBuffers[0], 2 + numClusters, iNumFaces, &pfFirstFrame, 1, iNumVertices, pfCameraPositions, numViews, CANVASWIDTH, CANVASHEIGHT, &pool);
+		free(piMeanIndexBuffers);
 	}
-	for (i = 0; i < count; i++)
+	if (rayReport)
 	{
-		frameId = cluster[i].frameId;
-		viewId = cluster[i].viewId;
-		for (j = 0; j < numPatches; j++)
+		std::vector<PatchId> fanvertOrder(numPatches);
+		for (int i = 0; i < numPatches; i++)
+			fanvertOrder[i] = (PatchId)i;
+		std::vector<std::string> meanNames(numClusters);
+		std::vector<const char *> names(1 + numClusters);
+		std::vector<PatchId *> orders(1 + numClusters);
+		names[0] = "fanvert"; orders[0] = &fanvertOrder[0];
+		for (int i = 0; i < numClusters; i++)
 		{
-			viewToPatch[j].dist += dist(pvCameraPosiitons[viewId], pvFramesPatchesPositions[frameId][j]);
+			meanNames[i] = "cluster " + std::to_string(i);
+			names[1 + i] = meanNames[i].c_str();
+			orders[1 + i] = means[i];
 		}
+		printRayEstimateReport(&names[0], &orders[0], 1 + numClusters, rayCoverage(), exactCoverage());
 	}
-	std::sort(viewToPatch, viewToPatch + numPatches, sortfunc);
-	//if (clusterId == 0)
+	//initMeans(pvFramesPatchesPositions, piIndexBufferOut, piClustersOut, numFrames, numClusters, numPatches, pickIds, pfCameraPositions, means, piScratch);
+	//// delete later
+	//int assignments[INUMFRAMES][INUMVIEWS];
+	//myFile = fopen("assignments.txt","r");
+	//int count = 0,viewId,frameId;
+	//for (int i = 0; i < INUMFRAMES*INUMVIEWS; i++)
+	//{
+	//	frameId = i / INUMVIEWS;
+	//	viewId = i%INUMVIEWS;
+	//	fscanf(myFile, "%d \n", &assignments[frameId][viewId]);
+	//}
+	//fclose(myFile);
+	//float minRatios[INUMFRAMES][INUMVIEWS];
+	//for (int i = 0; i < INUMFRAMES; i++)
 	//{
-	//	viewToPatch[417].id = 431;
-	//	viewToPatch[418].id = 346;
+	//	for (int j = 0; j < INUMVIEWS; j++)
+	//	{
+	//		minRatios[i][j] = 1.0;
+	//	}
 	//}
-	int jj = 0;
-	for (i = 0; i < numPatches; i++)
+	
+	
+	// the orderings are stored as patch permutations next to the one clustered index buffer they permute
+	char orderingsPath[400];
+	strcpy(orderingsPath, vfFolder);
+	strcat(orderingsPath, "orderings.vfo");
+	writePatchOrders(orderingsPath, means, numClusters, numPatches, piIndexBufferOut, piClustersOut, iNumFaces);
+
+	//AppMain(pfFramesVertexPositionsIn, numFrames, pfCameraPositions, numViews, means, numClusters, numPatches, piIndexBufferOut, piClustersOut, iNumVertices, iNumFaces);
+	tend = time(0);
+	std::cout << "It took" << difftime(tend, tstart) << "second(s)." << std::endl;
+	return EXIT_SUCCESS;
+}
+
+// one configuration of the GL evaluation for glSelfCheck
+struct GLCheckConfig
+{
+	const char *name;
+	bool gpuReduce;
+	bool exactCount;
+	int maxPageLayers;
+};
+// largest per view ratio difference to the software rasterizer; the two only differ on pixels whose center lies
+// on a triangle edge
+#define GLCHECKTOLERANCE 0.03f
+
+// renders the first frame of one animation with every GL evaluation path (CPU readback of the PBO ring, compute
+// reduction, R32UI fragment counts, several layer pages of one multi draw each) for the FanVertCluster order and
+// its reverse, and compares the per view overdraw with softwareOverdraw
+static int glSelfCheck(const DatasetEntry *entry, ThreadPool &pool)
+{
+	int iNumVertices = entry->iNumVertices; int iNumFaces = entry->iNumFaces; int numViews = entry->numViews;
+	const char *vfFolder = entry->vfFolder;
+	std::vector<int> indexBufferIn(iNumFaces * 3), indexBufferOut(iNumFaces * 3), clusters(iNumFaces * 3);
+	std::vector<float> cameraPositions(numViews * 3), firstFrame(iNumVertices * 3);
+	float *pfFirstFrame = &firstFrame[0];
+	char path[400];
+	strcpy(path, vfFolder);
+	strcat(path, "face.txt");
+	bool ok = loadTextInts(path, &indexBufferIn[0], iNumFaces * 3, &pool);
+	strcpy(path, vfFolder);
+	strcat(path, "newViewpoint3.txt");
+	ok = ok && loadTextFloats(path, &cameraPositions[0], numViews * 3, &pool);
+	if (hasSkinnedMesh(vfFolder))
 	{
-		for (j = piClustersIn[viewToPatch[i].id] * 3; j < piClustersIn[viewToPatch[i].id + 1] * 3; j++)
-		{
-			newMean[jj++] = piIndexBufferIn[j];
-		}
+		SkinnedMesh skinnedMesh;
+		memset(&skinnedMesh, 0, sizeof(skinnedMesh));
+		ok = ok && loadSkinnedMesh(vfFolder, iNumVertices, entry->numFrames, &skinnedMesh, &pool);
+		if (ok)
+			skinFrames(&skinnedMesh, 0, 1, &pfFirstFrame, NULL);
+		freeSkinnedMesh(&skinnedMesh);
 	}
-	float newRatio = newClusterRatio();
-	if (newRatio < avgRatio)
+	else
 	{
-		moved = true;
-		std::cout << "new Ratio is less" << std::endl;
-		// copy the new mean to old Mean
-		memcpy(clusterMean, newMean,numFaces*3* sizeof(newMean));
+		ok = ok && loadTextFrames(vfFolder, 0, 1, &pfFirstFrame, iNumVertices, &pool);
 	}
-	else{
-		std::cout << "old ratio is less" << std::endl;
+	if (!ok)
+		return EXIT_FAILURE;
+	int numPatches = 0;
+	FanVertCluster(pfFirstFrame, &indexBufferIn[0], &indexBufferOut[0], iNumVertices, iNumFaces, 20, 0.85f, NULL, &clusters[0], &numPatches);
+	if (numPatches > MAXPATCHES)
+	{
+		printf("ERROR: clustering gave %d patches, at most %d are supported\n", numPatches, MAXPATCHES);
+		return EXIT_FAILURE;
 	}
-
-	if (piScratch - piScratchBase > 0)
+	std::vector<PatchId> forwardOrder(numPatches), reverseOrder(numPatches);
+	for (int i = 0; i < numPatches; i++)
 	{
-		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+		forwardOrder[i] = (PatchId)i;
+		reverseOrder[i] = (PatchId)(numPatches - 1 - i);
 	}
-	if (bMalloc)
+	PatchId *means[2] = { &forwardOrder[0], &reverseOrder[0] };
+
+	// the 8 bit canvas saturates after 5 fragments, the R32UI counts do not
+	std::vector<float> viewMatrices(numViews * 16);
+	buildViewMatrices(&cameraPositions[0], numViews, (float)viewWidth / viewHeight, &viewMatrices[0]);
+	std::vector<int> meanIndexBuffer(iNumFaces * 3);
+	std::vector<OverdrawStats> exactStats(2 * numViews), saturatedStats(2 * numViews);
+	for (int j = 0; j < 2; j++)
 	{
-		free(piScratchBase);
+		expandPatchOrder(means[j], numPatches, &indexBufferOut[0], &clusters[0], &meanIndexBuffer[0]);
+		softwareOverdraw(pfFirstFrame, iNumVertices, &meanIndexBuffer[0], iNumFaces, &viewMatrices[0], numViews, viewWidth, viewHeight,
+			&exactStats[j * numViews], &pool);
+		softwareOverdraw(pfFirstFrame, iNumVertices, &meanIndexBuffer[0], iNumFaces, &viewMatrices[0], numViews, viewWidth, viewHeight,
+			&saturatedStats[j * numViews], &pool, 5);
 	}
 
-	return moved;
-}
-// moveMeans
-bool moveMeans(int ** means, int* piIndexBufferIn, int * piClustersIn, Vector  ** pvFramesPatchesPositions, Vector * pvCameraPositions, int ** assignments, float ** minRatios, int numClusters, int numPatches, int numViews, int numFrames,int numFaces, int *piScratch)
-{
-	int i, j, clusterId;
-	bool moved = false;
-	bool clusterMoved;
-	for (i = 0; i < 1; i++)
+	const GLCheckConfig configs[] = {
+		{ "PBO readback", false, false, 0 },
+		{ "PBO readback, 7 layer pages", false, false, 7 },
+		{ "compute reduction", true, false, 0 },
+		{ "R32UI counts", true, true, 0 },
+		{ "R32UI counts, 7 layer pages", true, true, 7 },
+	};
+	bool savedGpuReduce = gpuReduce, savedExactCount = exactCount;
+	int numFailed = 0;
+	std::vector<float> ratios;
+	for (int c = 0; c < (int)(sizeof(configs) / sizeof(configs[0])); c++)
 	{
-		clusterId = i;
-		clusterMoved = moveClusterMean(means[clusterId], clusterId, piIndexBufferIn, piClustersIn, pvFramesPatchesPositions, pvCameraPositions, assignments, minRatios, numPatches, numViews, numFrames, numFaces,piScratch);
-		if (clusterMoved == true)
+		gpuReduce = configs[c].gpuReduce;
+		exactCount = configs[c].exactCount;
+		maxPageLayers = configs[c].maxPageLayers;
+		ratios.clear();
+		pEvalRatios = &ratios;
+		try
 		{
-			moved == true;
+			AppMain(&pfFirstFrame, 1, &cameraPositions[0], numViews, means, 2, numPatches, &indexBufferOut[0], &clusters[0], iNumVertices, iNumFaces);
 		}
-	}
-	return moved;
-
-}
+		catch (const std::exception &e)
+		{
+			printf("ERROR: %s\n", e.what());
+			ratios.clear();
+		}
+		pEvalRatios = NULL;
 
-// the program starts here
-void AppMain(float ** pfVertexPositionsIn,float * pfCameraPosiitons, int ** piIndexBufferIn, int numVertices, int numFaces)
-{
-	// initialise GLFW
-	glfwSetErrorCallback(OnError);
-	glfwInit();
-	if (!glfwInit())
-		throw std::runtime_error("glfwInit failed");
-
-	// open a window with GLFW
-	if (offScreen)
-	{
-		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
-		gWindow = glfwCreateWindow(CANVASHEIGHT, CANVASHEIGHT, "", NULL, NULL);
-		glfwHideWindow(gWindow);
-	}
-	else{
-		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-		gWindow = glfwCreateWindow(CANVASWIDTH*CANVASXNUMS, CANVASHEIGHT*CANVASYNUMS, "openglTutrials", NULL, NULL);
+		const std::vector<OverdrawStats> &reference = exactCount ? exactStats : saturatedStats;
+		float maxDifference = 0.f;
+		bool passed = ratios.size() == reference.size();
+		for (size_t i = 0; passed && i < ratios.size(); i++)
+		{
+			// an empty view is 0 / 0 on the GPU, a view the GPU left empty gives NaN and fails
+			float difference = fabsf((reference[i].shownPixels > 0 ? ratios[i] : 0.f) - reference[i].ratio);
+			passed = difference <= GLCHECKTOLERANCE;
+			maxDifference = passed ? max(maxDifference, difference) : difference;
+		}
+		printf("%-30s max view difference %.4f %s\n", configs[c].name, maxDifference, passed ? "ok" : "FAILED");
+		if (!passed)
+			numFailed++;
 	}
-	
-	if (!gWindow)
-		throw std::runtime_error("glfwCreateWindow failed. Can your hardware handle OpenGL 3.2?");
-	glfwMakeContextCurrent(gWindow);
-	// initialise GLEW
-	glewExperimental = GL_TRUE; //stops glew crashing on OSX :-/
-	GLenum err = glewInit();
-	if (err != GLEW_OK)
+	gpuReduce = savedGpuReduce;
+	exactCount = savedExactCount;
+	maxPageLayers = 0;
+
+	// the GL OrderingEvaluator against coverageRatios, on all views of the frame
+	CoverageCache coverage;
+	buildCoverageCache(&pfFirstFrame, 1, iNumVertices, &indexBufferOut[0], &clusters[0], numPatches, iNumFaces, &cameraPositions[0], numViews,
+		viewWidth, viewHeight, &coverage, &pool);
+	std::vector<clusterAssign> members(numViews);
+	for (int viewId = 0; viewId < numViews; viewId++)
 	{
-		fprintf(stderr,"ERROR: %s\n",glewGetErrorString(err));
-		//throw std::runtime_error("glewInit failed");
+		members[viewId].frameId = 0;
+		members[viewId].viewId = viewId;
 	}
-		
-	glGenBuffers(1, &pixel_buffer);
-	
-	if (offScreen)
+	GLEvaluator evaluator;
+	bool passed = true;
+	float maxDifference = 0.f;
+	try
 	{
-		// Framebuffer
-		glGenFramebuffers(1, &fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-		// color renderbuffer
-		glGenRenderbuffers(1, &gColor);
-		glBindRenderbuffer(GL_RENDERBUFFER, gColor);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_RED, CANVASXNUMS*CANVASWIDTH, CANVASHEIGHT*CANVASYNUMS);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gColor);
-
-		glGenRenderbuffers(1, &rboDepth);
-		glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, CANVASXNUMS*CANVASWIDTH, CANVASYNUMS*CANVASHEIGHT);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-		if (status != GL_FRAMEBUFFER_COMPLETE)
+		beginGLEvaluator(&evaluator, &pfFirstFrame, 1, &cameraPositions[0], numViews, &indexBufferOut[0], &clusters[0], numPatches, iNumVertices, iNumFaces);
+		std::vector<float> glRatios(numViews), coverageRatiosOut(numViews);
+		for (int j = 0; passed && j < 2; j++)
 		{
-			std::cout << "framebuffer error:" << std::endl;
-			exit(EXIT_FAILURE);
+			glOrderingRatios(&evaluator, means[j], &members[0], numViews, &glRatios[0]);
+			coverageRatios(&coverage, means[j], &members[0], numViews, &coverageRatiosOut[0], &pool);
+			for (int i = 0; passed && i < numViews; i++)
+			{
+				float difference = fabsf(glRatios[i] - coverageRatiosOut[i]);
+				passed = difference <= GLCHECKTOLERANCE;
+				maxDifference = passed ? max(maxDifference, difference) : difference;
+			}
 		}
+		endGLEvaluator(&evaluator);
 	}
-
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE,GL_ONE);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
-	glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE);
-	// load vertex and fragment shaders into opengl
-	LoadShaders();
-
-	atomicCounterArray[0] = 0;
-	glGenBuffers(1, &ac_buffer);
-	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, ac_buffer);
-	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, ac_buffer);
-	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
-
-	GLuint baseInstance = 0;
-	GLuint numDraws = 0;
-	for (int i = 0; i < 30; i++)
+	catch (const std::exception &e)
 	{
-		for (int j = 0; j < 5; j++)
-		{
-			LoadTriangle(pfVertexPositionsIn[i], pfCameraPosiitons, piIndexBufferIn[j], numVertices, numFaces);
-			glViewport(0, 0, CANVASXNUMS*CANVASWIDTH, CANVASYNUMS*CANVASHEIGHT);
-			Render(baseInstance, numFaces);
-			numDraws++;
-		}
+		printf("ERROR: %s\n", e.what());
+		passed = false;
 	}
-	glfwTerminate();
+	printf("%-30s max view difference %.4f %s\n", "GL evaluator", maxDifference, passed ? "ok" : "FAILED");
+	if (!passed)
+		numFailed++;
+	return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-// malloc 2 dimension array
-template <typename T>
-T** new_Array2D(int row, int col)
-{
-	int size = sizeof(T);
-	int point_size = sizeof(T*);
-	//
-	T **arr = (T **)malloc(point_size * row + size * row * col);
-	if (arr != NULL)
+int main(int argc, char *argv[]) {
+	// usage: 04_camera [options] [root] [character animation | -all | -glcheck [character animation]]
+	// root is the VerticeFace folder; without a pair the first animation found is run.
+	// -all runs headless: the animations are processed side by side and a summary goes to <root>batch.txt
+	// -glcheck compares every GL evaluation path with the software rasterizer on the first frame, fails on a mismatch
+	// options, anywhere on the line:
+	// -context glfw|egl picks the GL context of the overdraw evaluation, egl needs no display
+	// -streamFrames -vcacheReport -overdrawReport -occlusionMeans -rayReport -rayEvaluate -glEvaluate -lloyd -miniBatch -autoClusters turn
+	// on the switch of the same name, -noLloyd (and so on) turns it off; only lloyd is on by default
+	int numArgs = 1;
+	for (int i = 1; i < argc; i++)
 	{
-		T *head = (T*)((int)arr + point_size * row);
-		for (int i = 0; i < row; ++i)
+		if (strcmp(argv[i], "-context") == 0 && i + 1 < argc)
 		{
-			arr[i] = (T*)((int)head + i * col * size);
-			for (int j = 0; j < col; ++j)
-				new (&arr[i][j]) T;
+			if (!parseGLContextBackend(argv[i + 1], &contextBackend))
+			{
+				printf("ERROR: unknown context %s, glfw or egl\n", argv[i + 1]);
+				return EXIT_FAILURE;
+			}
+			i++;
+		}
+		else if (!parseSwitchFlag(argv[i]))
+		{
+			argv[numArgs++] = argv[i];
 		}
 	}
-	return (T**)arr;
-}
-//release
-template <typename T>
-void delete_Array2D(T **arr, int row, int col)
-{
-	for (int i = 0; i < row; ++i)
-		for (int j = 0; j < col; ++j)
-			arr[i][j].~T();
-	if (arr != NULL)
-		free((void**)arr);
-}
-
-int main(int argc, char *argv[]) {
-	// parameters needed
-	int characterId = 1; int aniId = 0; float alpha = 0.85; int iCacheSize = 20;
-	char Character[5][20] = { "Ganfaul_M_Aure", "Kachujin_G_Rosales", "Maw_J_Laygo", "Nightshade" };
-	char Animation[7][40] = { "Crouch_Walk_Left", "dancing_maraschino_step", "Standing_2H_Cast_Spell", "Standing_2H_Magic_Area_Attack", "Standing_Jump", "Standing_React_Death_Backward", "Standing_React_Large_From_Back" };
-	int charVertices[4] = { 7865, 6675, 7482, 6691};
-	int charFaces[4] = { 13801, 12610, 13908, 12996};
-	int charPatches[4] = { 475, 482, 611, 387 };
-	int aniDuration[7] = { 30,75, 50, 70, 50, 45, 40 };
-	int numFrames = aniDuration[aniId]; int iNumVertices = charVertices[characterId]; int iNumFaces = charFaces[characterId];int numPatches = charPatches[characterId]; int numViews = 162;
-	int pickIds[5] = { 148, 54, 17, 92, 45 }; int numClusters = 5; 
-
-	// set memory
-	int * miScratch = NULL;
-	bool bMalloc = false;
-	if (miScratch == NULL)
-	{
-		int iScratchSize =  (iNumFaces* 3*3+ numViews*3) * sizeof(int);
-		miScratch = (int *)malloc(iScratchSize);
-		memset(miScratch, 0, iScratchSize);
-		bMalloc = true;
-	}
-	int *piScratchBase = miScratch;
-	int *piIndexBufferIn = miScratch;
-	miScratch += iNumFaces * 3;
-	int * piIndexBufferOut = miScratch;
-	miScratch += iNumFaces * 3;
-	int * piClustersOut = miScratch;
-	miScratch += iNumFaces * 3;
-	float * pfCameraPositions = (float*)miScratch;
-	miScratch += numViews * 3;
-	
-	float ** pfFramesVertexPositionsIn = new_Array2D<float>(numFrames,iNumVertices*3);
-	Vector ** pvFramesPatchesPositions = new_Array2D<Vector>(numFrames, numPatches);
-	int ** means = new_Array2D<int>(numClusters, iNumFaces * 3);
-	//int means[5][INUMFACES * 3];
-	time_t tstart, tend;
-
-	
-	//int piIndexBufferIn[INUMFACES * 3];
-	//int piIndexBufferOut[INUMFACES * 3];
-	//int piClustersOut[INUMFACES * 3];
-	//float pfFramesVertexPositionsIn[30][INUMVERTICES * 3];
-	//Vector  pvFramesPatchesPositions[numFrames][482];
-	//float pfCameraPositions[162 * 3];
-
-	int *piScratch = NULL; int iNumClusters;
-	char vfFolder[150]; char facePath[150]; char verticesPath[150]; char cameraPath[150];
-	strcpy(vfFolder, "D:/Hansf/Research/triangleordering/webstorm/VerticeFace/");
-	strcat(vfFolder, Character[characterId]);
-	strcat(vfFolder, "/");
-	strcat(vfFolder, Animation[aniId]);
-	strcat(vfFolder, "/");
-
-	FILE * myFile;
-	strcpy(facePath, vfFolder);
-	strcat(facePath, "face.txt");
-	std::cout << facePath << std::endl;
-	myFile = fopen(facePath, "r");
-	if (myFile == NULL)
-	{
-		printf("ERROR: File cannot be opened\n");
-	}
-	for (int i = 0; i < iNumFaces * 3; i++)
+	argc = numArgs;
+	// root is optional, a first argument starting with - is already the mode; arg is the one after root
+	char root[300];
+	strcpy(root, "VerticeFace/");
+	int arg = 1;
+	if (argc > 1 && argv[1][0] != '-' && strlen(argv[1]) < sizeof(root) - 1)
 	{
-		fscanf(myFile, "%d \n", &piIndexBufferIn[i]);
+		strcpy(root, argv[1]);
+		size_t len = strlen(root);
+		if (root[len - 1] != '/' && root[len - 1] != '\\')
+			strcat(root, "/");
+		arg = 2;
 	}
-	fclose(myFile);
-
-	strcpy(cameraPath, vfFolder);
-	strcat(cameraPath, "newViewpoint3.txt");
-
-	myFile = fopen(cameraPath, "r");
-	for (int i = 0; i < numViews * 3; i++)
+	std::vector<DatasetEntry> entries;
+	if (!discoverDataset(root, entries))
+		return EXIT_FAILURE;
+
+	std::vector<DatasetEntry> queue;
+	bool batchRun = argc > arg && strcmp(argv[arg], "-all") == 0;
+	bool glCheck = argc > arg && strcmp(argv[arg], "-glcheck") == 0;
+	int pairArg = glCheck ? arg + 1 : arg;
+	if (batchRun)
 	{
-		fscanf(myFile, "%f \n", &pfCameraPositions[i]);
+		queue = entries;
 	}
-	fclose(myFile);
-	Vector *pvCameraPositions = (Vector *)pfCameraPositions;
-	for (int frameId = 0; frameId < numFrames; frameId++)
+	else if (argc > pairArg + 1)
 	{
-		char buffer[50];
-		itoa(frameId + 1, buffer, 10);
-		strcpy(verticesPath, vfFolder);
-		strcat(verticesPath, "frame");
-		strcat(verticesPath, buffer);
-		strcat(verticesPath, "v.txt");
-
-		myFile = fopen(verticesPath, "r");
-		if (myFile == NULL)
+		for (size_t i = 0; i < entries.size(); i++)
 		{
-			printf("ERROR : File cannot be opened\n");
+			if (strcmp(entries[i].character, argv[pairArg]) == 0 && strcmp(entries[i].animation, argv[pairArg + 1]) == 0)
+				queue.push_back(entries[i]);
 		}
-		for (int i = 0; i < iNumVertices * 3; i++)
+		if (queue.empty())
 		{
-			fscanf(myFile, "%f\n", &pfFramesVertexPositionsIn[frameId][i]);
+			printf("ERROR: %s/%s is not in the dataset under %s\n", argv[pairArg], argv[pairArg + 1], root);
+			return EXIT_FAILURE;
 		}
-		fclose(myFile);
 	}
-
-	FanVertCluster(pfFramesVertexPositionsIn[0], piIndexBufferIn, piIndexBufferOut, iNumVertices, iNumFaces, iCacheSize, alpha, piScratch, piClustersOut, &iNumClusters);
-	
-	for (int i = 0; i < numFrames; i++)
+	else
 	{
-		pvPatchesPostions(piIndexBufferOut, iNumFaces, pfFramesVertexPositionsIn[i], iNumVertices, piClustersOut, iNumClusters, pvFramesPatchesPositions[i], piScratch);
+		queue.push_back(entries[0]);
 	}
 
-	// start point
-	tstart = time(0);
-	initMeans(means, pvFramesPatchesPositions, piIndexBufferOut, piClustersOut, numFrames, numClusters, numPatches, iNumFaces, pickIds, pfCameraPositions, piScratch);
-	//initMeans(pvFramesPatchesPositions, piIndexBufferOut, piClustersOut, numFrames, numClusters, numPatches, pickIds, pfCameraPositions, means, piScratch);
-	//// delete later
-	//int assignments[INUMFRAMES][INUMVIEWS];
-	//myFile = fopen("assignments.txt","r");
-	//int count = 0,viewId,frameId;
-	//for (int i = 0; i < INUMFRAMES*INUMVIEWS; i++)
-	//{
-	//	frameId = i / INUMVIEWS;
-	//	viewId = i%INUMVIEWS;
-	//	fscanf(myFile, "%d \n", &assignments[frameId][viewId]);
-	//}
-	//fclose(myFile);
-	//float minRatios[INUMFRAMES][INUMVIEWS];
-	//for (int i = 0; i < INUMFRAMES; i++)
-	//{
-	//	for (int j = 0; j < INUMVIEWS; j++)
-	//	{
-	//		minRatios[i][j] = 1.0;
-	//	}
-	//}
-	
-	
-	/*char meansFile[50];
-	char meansbuffer[50];
-	itoa(clusterId, meansbuffer, 10);
-	strcpy(meansFile, "newMeans");
-	strcat(meansFile, meansbuffer);
-	strcat(meansFile, ".txt");
-	myFile = fopen(meansFile, "w");
-	for (int j = 0; j < INUMFACES * 3; j++)
+	ThreadPool pool;
+	if (glCheck)
+		return glSelfCheck(&queue[0], pool);
+	if (!batchRun)
 	{
-	fprintf(myFile, "%d \n", means[0][j]);
+		int result = processAnimation(&queue[0], pool);
+		getchar();
+		return result;
 	}
-	fclose(myFile);*/
 
-	//AppMain(pfFramesVertexPositionsIn, pfCameraPositions, means, iNumVertices, iNumFaces);
-	tend = time(0);
-	std::cout << "It took" << difftime(tend, tstart) << "second(s)." << std::endl;
-	getchar();
+	std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+	// every job holds a whole animation with its caches, more of them only add memory once the pool is busy
+	int maxJobsInFlight = 2;
+	// there is one GL context, the jobs would take it from each other
+	if (glEvaluate)
+		maxJobsInFlight = 1;
+	std::vector<BatchJob> jobs = runBatch(queue, &pool, maxJobsInFlight, [&](const DatasetEntry *entry) -> bool {
+		return processAnimation(entry, pool) == EXIT_SUCCESS;
+	});
+	double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+	char summaryPath[400];
+	strcpy(summaryPath, root);
+	strcat(summaryPath, "batch.txt");
+	printBatchSummary(jobs, batchSeconds, summaryPath);
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (!jobs[i].ok)
+			return EXIT_FAILURE;
+	}
 	return EXIT_SUCCESS;
 }
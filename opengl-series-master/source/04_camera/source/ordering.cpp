@@ -0,0 +1,1099 @@
+#include "ordering.h"
+#include "jobLog.h"
+#include "threadPool.h"
+#include "vcacheSim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ORDERING_SSE
+#endif
+
+#define cf(p, c, v) (((p-c+2*v) > iCacheSize) ? (0) : (p-c))
+
+//function that computes size of scratch memory
+int FanVertScratchSize(int iNumVertices, int iNumFaces)
+{
+	return (iNumFaces * 22 + iNumVertices + 3) * sizeof(int);
+}
+
+//function that implements the vcache optimization
+float FanVertLinSort(int *piIndexBufferIn, int *piIndexBufferOut, int iNumFaces, int *piScratch, int iCacheSize, int *piClustersOut, int &iNumClusters)
+{
+	int i = 0;
+	int iNumFaces3 = iNumFaces * 3;
+	int sum = 0;
+	int lowi = 0;
+	int j = 0;
+	int next = -1;
+	int id;
+
+	iNumClusters = 1;
+	if (piClustersOut)
+		piClustersOut[0] = 0;
+
+	//set array pointers from scratch buffer
+	int *piEmitted = piScratch;
+	int *piFanList = piEmitted + iNumFaces;
+	int *piTriList = piFanList + iNumFaces3;
+
+	int *piStartList = piTriList + iNumFaces3;
+	int *piStartListTail = piStartList;
+
+	int *piRemValence = piStartList + iNumFaces3;
+
+	int *piCachePos = piRemValence + iNumFaces3;
+
+	int *piFanPos = piCachePos + iNumFaces3;
+
+
+	int iCurCachePos = 1 + iCacheSize; //so that cache position of 0 is out of cache
+	int iCurCachePosFan;
+
+	int nv = 0;
+	for (i = 0; i < iNumFaces3; i++)
+	{
+		register int ind = piIndexBufferIn[i];
+		piFanPos[ind]++;
+		if (piFanPos[ind] == 1)
+			piFanList[nv++] = ind;
+	}
+	for (i = 0; i < nv; i++)
+	{
+		int x = piFanPos[piFanList[i]];
+		piRemValence[sum] = x;
+		sum = (piFanPos[piFanList[i]] += sum);
+	}
+	for (i = 0; i < iNumFaces3; i++)
+	{
+		piTriList[--piFanPos[piIndexBufferIn[i]]] = i;
+	}
+
+	i = 0;
+
+	//loop through extracting the triangles for the optimized buffer
+	while (lowi < iNumFaces3)
+	{
+		int bestemitted = -INT_MAX;
+		int tribest = -1;
+
+		//set current vertex id
+		id = piIndexBufferIn[piTriList[i]];
+
+		next = -1;
+
+		iCurCachePosFan = iCurCachePos;
+
+		//loop through extracting all faces from a vertex fan that were not previously written
+		while (i < iNumFaces3 && piIndexBufferIn[piTriList[i]] == id)
+		{
+			//get triangle id, and starting index of that triangle in original buffer (tri3)
+			int tri = piTriList[i] / 3;
+			int tri3 = tri * 3;
+
+			if (++piEmitted[tri] == 1)
+			{
+				int *pin = &piIndexBufferIn[tri3];
+				int ord = 0;
+				for (int ii = 0; ii < 3; ii++, pin++)
+				{
+					piIndexBufferOut[j++] = *pin;
+
+					int x = piFanPos[*pin];
+
+					int t = iCurCachePos - piCachePos[x] > iCacheSize;
+					if (t)
+					{
+						piCachePos[x] = iCurCachePos++;
+					}
+
+					int v = --piRemValence[x];
+					if (v > 0 && *pin != id)
+					{
+						if (t)
+						{
+							*(piStartListTail++) = *pin;
+						}
+						int f = cf(iCurCachePosFan, piCachePos[x], v);
+						if (f > bestemitted)
+						{
+							bestemitted = f;
+							next = *pin;
+						}
+					}
+				}
+			}
+
+			//increment counters into piTriList
+			if (i == lowi)
+				lowi++;
+			i++;
+		}
+
+		//reset its fan position, so that it doesn't get processed twice
+		piFanPos[id] = 0;
+
+		if (next == -1)
+		{
+			int notfound = 1;
+
+			while (piStartListTail > piStartList)
+			{
+				i = piFanPos[*(--piStartListTail)];
+				if (i > 0)
+				{
+					notfound = 0;
+					break;
+				}
+			}
+
+			if (notfound)
+			{
+				while (lowi < iNumFaces3 && !piFanPos[piIndexBufferIn[piTriList[lowi]]])
+				{
+					lowi++;
+				}
+				i = lowi;
+			}
+
+			//overdraw output
+			if (piClustersOut && piClustersOut[iNumClusters - 1] != j / 3 && iCurCachePos - piCachePos[i] > iCacheSize * 2)
+			{
+				piClustersOut[iNumClusters++] = j / 3;
+			}
+		}
+		//if we have a neighboring id to fan around, set it as current
+		else
+		{
+			i = piFanPos[next];
+		}
+	}
+
+	//clear temp array (only the elements used)
+	for (i = 0; i < nv; i++)
+	{
+		piFanPos[piFanList[i]] = 0;
+	}
+	memset(piScratch, 0, (iNumFaces * 16) * sizeof(int));
+
+	if (piClustersOut && piClustersOut[iNumClusters - 1] == iNumFaces)
+		iNumClusters--;
+
+	return (iCurCachePos - iCacheSize - 1) / (float)iNumFaces;
+}
+
+//function that implements the linear cutting
+int OverdrawOrderPartition(int *piIndexBufferIn,
+	int iNumFaces,
+	int iNumVertices,
+	int *piClustersIn, //should have piClustersIn[iNumClusters] == iNumFaces
+	int iNumClustersIn,
+	int iCacheSize,
+	float lambda,
+	int *piClustersOut,
+	int *piScratch)    //needs VCacheSimScratchSize(VCACHE_FIFO, iNumVertices) ints
+{
+	VCacheSim sim;
+	initVCacheSim(&sim, VCACHE_FIFO, iCacheSize, iNumVertices, piScratch);
+
+	int i;
+	int j = 0;
+
+	for (i = 0; i < iNumClustersIn; i++)
+	{
+		piClustersOut[j++] = piClustersIn[i];
+		int *p = piIndexBufferIn + piClustersIn[i] * 3;
+		int n = piClustersIn[i + 1] - piClustersIn[i];
+		int start = piClustersIn[i];
+		int k;
+		int iProc = 0;
+		flushVCacheSim(&sim);
+		for (k = 0; k < n; k++, p += 3)
+		{
+			iProc += accessVCacheFace(&sim, p);
+
+			float fEstProc = iProc / (float)(k + 1);
+			if (k > 0 && lambda > fEstProc)
+			{
+				start += k;
+				piClustersOut[j++] = start;
+				n -= k;
+				k = -1;
+				p -= 3;
+				iProc = 0;
+				flushVCacheSim(&sim);
+			}
+		}
+	}
+	piClustersOut[j] = iNumFaces;
+
+	finishVCacheSim(&sim);
+
+	return j;
+}
+
+// function implements the linear sorting
+// output the linearFace(piIndexBufferOut), iNumColusters, piClustersOut (set patches)
+void FanVertCluster(float *pfVertexPositionsIn,   //vertex buffer positions, 3 floats per vertex
+	int *piIndexBufferIn,         //index buffer positions, 3 ints per vertex
+	int *piIndexBufferOut,        //updated index buffer (the output of the algorithm)
+	int iNumVertices,             //# of vertices in the vertex buffer
+	int iNumFaces,                //# of faces in the index buffer
+	int iCacheSize,               //hardware cache size
+	float alpha,                  //constant parameter to compute lambda term from algorithm 
+	int *piScratch,               //optional temp buffer for computations; its size in bytes should be FanVertScratchSize
+	int *piClustersOut,           //optional buffer for the output cluster position (in faces) of each cluster
+	int *piNumClustersOut)        //the number of putput clusters
+{
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		int iScratchSize = FanVertScratchSize(iNumVertices, iNumFaces);
+		piScratch = (int *)malloc(iScratchSize);
+		memset(piScratch, 0, iScratchSize);
+		bMalloc = true;
+	}
+	int *piScratchBase = piScratch;
+
+	int *piIndexBufferTmp = piScratch;
+	piScratch += iNumFaces * 3;
+
+	int *piClustersIn = piScratch;
+	piScratch += iNumFaces + 1;
+
+	int *piClustersTmp = piScratch;
+	piScratch += iNumFaces + 1;
+
+	int *piClusterRemap = piScratch;
+	piScratch += iNumFaces + 1;
+
+
+	int iNumClusters;
+	float lambda = FanVertLinSort(piIndexBufferIn, piIndexBufferTmp, iNumFaces,
+		piScratch, iCacheSize, piClustersIn, iNumClusters);
+
+	lambda = alpha;
+
+	int iNumClustersOut = OverdrawOrderPartition(piIndexBufferTmp, iNumFaces, iNumVertices,
+		piClustersIn, iNumClusters, iCacheSize, lambda, piClustersTmp, piScratch);
+
+	if (piNumClustersOut != NULL){
+		*piNumClustersOut = iNumClustersOut;
+	}
+	if (piClustersTmp[iNumClustersOut] != iNumFaces)
+	{
+		jobPrintf("DOH\n");
+	}
+
+	for (int i = 0; i < iNumFaces * 3; i++)
+	{
+		piIndexBufferOut[i] = piIndexBufferTmp[i];
+	}
+	for (int i = 0; i < iNumClustersOut + 1; i++)
+	{
+		piClustersOut[i] = piClustersTmp[i];
+	}
+	if (piScratch - piScratchBase > 0)
+		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int)); //clear memory from tmp
+	if (bMalloc)
+	{
+		free(piScratchBase);
+	}
+}
+
+//function that implements getting patches positions
+void pvPatchesPostions(int *piIndexBufferIn,
+	int iNumFaces,
+	float *pfVertexPositionsIn,
+	int iNumVertices,
+	int *piClustersIn,
+	int iNumClusters,
+	Vector * pvPatchesPositions,
+	int *piScratch
+	)
+{
+	int i, j;
+	int c = 0, cstart = 0;
+	int cnext = piClustersIn[1];
+	int *p = piIndexBufferIn;
+	Vector *pvVertexPositionsIn = (Vector *)pfVertexPositionsIn;
+	Vector vMeshPositions = Vector(0, 0, 0);
+	float fMArea = 0.f;
+
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		int iScratchSize = FanVertScratchSize(iNumVertices, iNumFaces);
+		piScratch = (int *)malloc(iScratchSize);
+		memset(piScratch, 0, iScratchSize);
+		bMalloc = true;
+	}
+	int *piScratchBase = piScratch;
+	Vector *pvClusterPositions = (Vector *)piScratch;
+	piScratch += iNumClusters * 3;
+
+	Vector *pvClusterNormals = (Vector *)piScratch;
+	piScratch += iNumClusters * 3;
+
+	float *pfClusterAreas = (float *)piScratch;
+	piScratch += iNumClusters;
+
+	for (i = 0; i < iNumClusters; i++)
+	{
+		pvClusterPositions[i] = Vector(0, 0, 0);
+		pvClusterNormals[i] = Vector(0, 0, 0);
+	}
+	float fCArea = 0.f;
+
+	for (i = 0; i <= iNumFaces; i++)
+	{
+		if (i == cnext)
+		{
+			pfClusterAreas[c] = fCArea;
+			pvClusterPositions[c] /= fCArea * 3.f;
+			pvClusterNormals[c].normalize();
+			c++;
+			if (c == iNumClusters)
+				break;
+			cstart = i;
+			cnext = piClustersIn[c + 1];
+			fCArea = 0.f;
+		}
+
+		Vector vNormal = cross(pvVertexPositionsIn[p[2]] - pvVertexPositionsIn[p[0]],
+			pvVertexPositionsIn[p[1]] - pvVertexPositionsIn[p[0]]);
+		float fArea = vNormal.length();
+		if (fArea > 0.f)
+		{
+			vNormal /= fArea;
+		}
+		else
+		{
+			fArea = 0.f;
+			vNormal = Vector(0, 0, 0);
+		}
+
+		for (j = 0; j < 3; j++)
+		{
+			Vector *vp = (Vector *)&pfVertexPositionsIn[(*p) * 3];
+			vMeshPositions += *vp * fArea;
+			pvClusterPositions[c] += *vp * fArea;
+			p++;
+		}
+
+		pvClusterNormals[c] += vNormal;
+
+		fMArea += fArea;
+		fCArea += fArea;
+	}
+	vMeshPositions /= fMArea * 3.f;
+	for (int i = 0; i < iNumClusters; i++){
+		pvPatchesPositions[i] = Vector(pvClusterPositions[i].v[0], pvClusterPositions[i].v[1], pvClusterPositions[i].v[2]);
+	}
+	
+	if (piScratch - piScratchBase > 0)
+	{
+		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+	}
+	if (bMalloc)
+	{
+		free(piScratchBase);
+	}
+}
+
+// streaming version of pvPatchesPostions over a whole animation: only two frames of vertices are resident,
+// frame i+1 is produced by loadFrame (text file or skinning) while frame i is reduced to its patch positions
+bool streamPatchesPositions(const std::function<bool(int, float *)> &loadFrame,
+	int numFrames,
+	int iNumVertices,
+	int *piIndexBufferIn,
+	int iNumFaces,
+	int *piClustersIn,
+	int iNumClusters,
+	Vector ** pvFramesPatchesPositions,
+	ThreadPool *pool
+	)
+{
+	float *pfFrameBuffers = (float *)malloc(2 * iNumVertices * 3 * sizeof(float));
+	float *pfCurrent = pfFrameBuffers;
+	float *pfNext = pfFrameBuffers + iNumVertices * 3;
+	bool ok = loadFrame(0, pfCurrent);
+	for (int frameId = 0; ok && frameId < numFrames; frameId++)
+	{
+		bool nextOk = true;
+		parallelFor(pool, 0, 2, [&](int task) {
+			if (task == 0)
+			{
+				if (frameId + 1 < numFrames)
+					nextOk = loadFrame(frameId + 1, pfNext);
+			}
+			else
+			{
+				pvPatchesPostions(piIndexBufferIn, iNumFaces, pfCurrent, iNumVertices, piClustersIn, iNumClusters, pvFramesPatchesPositions[frameId], NULL);
+			}
+		});
+		ok = nextOk;
+		std::swap(pfCurrent, pfNext);
+	}
+	free(pfFrameBuffers);
+	return ok;
+}
+
+// function that implements rank patches from near to far, the ordering is written as a patch permutation
+void depthSortPatch(Vector viewpoint, Vector * pvAvgPatchesPositions, int numPatches, PatchId * pusPatchOrderOut)
+{
+	int i;
+	int * piScratch = NULL;
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		int iScratchSize = numPatches * 2 * sizeof(int);
+		piScratch = (int *)malloc(iScratchSize);
+		memset(piScratch, 0, iScratchSize);
+		bMalloc = true;
+	}
+	int *piScratchBase = piScratch;
+	patchSort *viewToPatch = (patchSort *)piScratch;
+	piScratch += numPatches * 2;
+
+	for (i = 0; i < numPatches; i++)
+	{
+		viewToPatch[i].id = i;
+		viewToPatch[i].dist = dist(viewpoint, pvAvgPatchesPositions[i]);
+	}
+	std::sort(viewToPatch, viewToPatch + numPatches, sortfunc);
+	//std::cout << viewToPatch[0].dist << " " << viewToPatch[1].dist << " " << viewToPatch[2].dist << std::endl;
+
+	for (i = 0; i < numPatches; i++)
+	{
+		pusPatchOrderOut[i] = (PatchId)viewToPatch[i].id;
+	}
+
+	if (piScratch - piScratchBase > 0)
+	{
+		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+	}
+	if (bMalloc)
+	{
+		free(piScratchBase);
+	}
+}
+// function that implements the initializition
+void initMeans(PatchId ** means, Vector ** pvFramesPatchesPositions, int numFrames, int numClusters, int numPatches, int * pickIds, float * pfCameraPositions, int * piScratch)
+{
+	int i, j;
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		int iScratchSize = numPatches * 3 * sizeof(int);
+		piScratch = (int *)malloc(iScratchSize);
+		memset(piScratch, 0, iScratchSize);
+		bMalloc = true;
+	}
+	int *piScratchBase = piScratch;
+	Vector *pvAvgPatchesPositions = (Vector *)piScratch;
+	piScratch += numPatches * 3;
+
+	for (i = 0; i < numFrames; i++)
+	{
+		for (j = 0; j < numPatches; j++)
+		{
+			pvAvgPatchesPositions[j] += pvFramesPatchesPositions[i][j];
+		}
+	}
+	for (j = 0; j < numPatches; j++)
+	{
+		pvAvgPatchesPositions[j] /= numFrames;
+	}
+
+	for (i = 0; i < numClusters; i++)
+	{
+		Vector viewpoint = Vector(pfCameraPositions[pickIds[i] * 3], pfCameraPositions[pickIds[i] * 3 + 1], pfCameraPositions[pickIds[i] * 3 + 2]);
+		depthSortPatch(viewpoint, pvAvgPatchesPositions, numPatches, means[i]);
+	}
+	if (piScratch - piScratchBase > 0)
+	{
+		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+	}
+	if (bMalloc)
+	{
+		free(piScratchBase);
+	}
+}
+
+// patch pairs ranked differently by the two orders, merge sort inversions of b in the ranks of a
+long long kendallTauDistance(const PatchId *pusOrderA, const PatchId *pusOrderB, int numPatches, int *piScratch)
+{
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		piScratch = (int *)malloc(numPatches * 3 * sizeof(int));
+		bMalloc = true;
+	}
+	int *piRank = piScratch, *piSeq = piScratch + numPatches, *piTmp = piScratch + numPatches * 2;
+	for (int i = 0; i < numPatches; i++)
+		piRank[pusOrderA[i]] = i;
+	for (int i = 0; i < numPatches; i++)
+		piSeq[i] = piRank[pusOrderB[i]];
+	long long inversions = 0;
+	for (int width = 1; width < numPatches; width *= 2)
+	{
+		for (int lo = 0; lo < numPatches - width; lo += width * 2)
+		{
+			int mid = lo + width, hi = std::min(lo + width * 2, numPatches);
+			int a = lo, b = mid, k = lo;
+			while (a < mid && b < hi)
+			{
+				if (piSeq[b] < piSeq[a])
+				{
+					inversions += mid - a;
+					piTmp[k++] = piSeq[b++];
+				}
+				else
+					piTmp[k++] = piSeq[a++];
+			}
+			while (a < mid)
+				piTmp[k++] = piSeq[a++];
+			while (b < hi)
+				piTmp[k++] = piSeq[b++];
+			memcpy(piSeq + lo, piTmp + lo, (hi - lo) * sizeof(int));
+		}
+	}
+	if (bMalloc)
+	{
+		free(piScratch);
+	}
+	return inversions;
+}
+
+// greedy k-means++ over the distance orders of the views
+void seedViews(Vector ** pvFramesPatchesPositions, int numFrames, int numPatches, const float * pfCameraPositions, int numViews, int numClusters,
+	int maxClusters, unsigned int seed, int * pickIds, ThreadPool *pool)
+{
+	std::vector<Vector> avgPositions(numPatches, Vector(0.f, 0.f, 0.f));
+	for (int i = 0; i < numFrames; i++)
+		for (int j = 0; j < numPatches; j++)
+			avgPositions[j] += pvFramesPatchesPositions[i][j];
+	for (int j = 0; j < numPatches; j++)
+		avgPositions[j] /= numFrames;
+
+	std::vector<PatchId> orders((size_t)numViews * numPatches);
+	parallelFor(pool, 0, numViews, [&](int v) {
+		Vector viewpoint = Vector(pfCameraPositions[v * 3], pfCameraPositions[v * 3 + 1], pfCameraPositions[v * 3 + 2]);
+		depthSortPatch(viewpoint, &avgPositions[0], numPatches, &orders[(size_t)v * numPatches]);
+	});
+
+	// xorshift32, as in the ray estimator
+	unsigned int state = seed * 2654435761u + 1u;
+	std::vector<char> picked(numViews, 0);
+	std::vector<double> nearest(numViews, 0.0);
+	// a view not picked yet, with a probability proportional to its squared distance to the picks (uniform first)
+	auto drawView = [&](bool uniform) -> int {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		double total = 0.0;
+		for (int v = 0; v < numViews; v++)
+			total += picked[v] ? 0.0 : (uniform ? 1.0 : nearest[v] * nearest[v]);
+		double target = (state / 4294967296.0) * total;
+		int last = -1;
+		for (int v = 0; v < numViews; v++)
+		{
+			if (picked[v])
+				continue;
+			last = v;
+			target -= uniform ? 1.0 : nearest[v] * nearest[v];
+			if (target < 0.0)
+				return v;
+		}
+		// rounding ran past the end, or every view left repeats a pick
+		return last;
+	};
+	auto distancesTo = [&](int pick, double *pdDistances) {
+		const PatchId *pusPick = &orders[(size_t)pick * numPatches];
+		parallelFor(pool, 0, numViews, [&](int v) {
+			std::vector<int> scratch(numPatches * 3);
+			pdDistances[v] = (double)kendallTauDistance(pusPick, &orders[(size_t)v * numPatches], numPatches, &scratch[0]);
+		});
+	};
+
+	// greedy k-means++: of a few drawn candidates the one that lowers the summed squared distance the most is kept
+	int numTrials = 2 + (int)log((double)std::max(std::max(numClusters, maxClusters), 1));
+	std::vector<double> trialDistances((size_t)numTrials * numViews);
+	for (int i = 0; i < numClusters; i++)
+	{
+		int pick = -1;
+		if (i == 0)
+		{
+			pick = drawView(true);
+			distancesTo(pick, &nearest[0]);
+		}
+		else
+		{
+			double bestPotential = 0.0;
+			int bestTrial = -1;
+			for (int t = 0; t < numTrials; t++)
+			{
+				int candidate = drawView(false);
+				if (candidate == -1)
+					break;
+				double *pdDistances = &trialDistances[(size_t)t * numViews];
+				distancesTo(candidate, pdDistances);
+				double potential = 0.0;
+				for (int v = 0; v < numViews; v++)
+				{
+					double d = std::min(nearest[v], pdDistances[v]);
+					potential += d * d;
+				}
+				if (bestTrial == -1 || potential < bestPotential)
+				{
+					pick = candidate;
+					bestTrial = t;
+					bestPotential = potential;
+				}
+			}
+			if (bestTrial != -1)
+			{
+				for (int v = 0; v < numViews; v++)
+					nearest[v] = std::min(nearest[v], trialDistances[(size_t)bestTrial * numViews + v]);
+			}
+		}
+		// fewer views than clusters: the views repeat
+		if (pick == -1)
+			pick = i % numViews;
+		pickIds[i] = pick;
+		picked[pick] = 1;
+	}
+}
+
+// function that implements the assignments
+#define ASSIGNBLOCK 4096
+int makeAssignment(const float *pfRatios, int **assignments, float **minRatios, int numFrames, int numViews, int numClusters, ThreadPool *pool)
+{
+	int numPairs = numFrames * numViews;
+	int numBlocks = (numPairs + ASSIGNBLOCK - 1) / ASSIGNBLOCK;
+	std::vector<int> blockChanged(numBlocks, 0);
+	// blocks of (frame, view) pairs, each argmin keeps the first of equal ratios
+	parallelFor(pool, 0, numBlocks, [&](int block) {
+		int begin = block * ASSIGNBLOCK, end = std::min(begin + ASSIGNBLOCK, numPairs);
+		int best[4], changed = 0;
+		float minRatio[4];
+		int i = begin;
+#ifdef ORDERING_SSE
+		// 4 pairs side by side, their rows are contiguous
+		for (; i + 4 <= end; i += 4)
+		{
+			const float *r = pfRatios + (size_t)i * numClusters;
+			__m128 vMin = _mm_set_ps(r[3 * numClusters], r[2 * numClusters], r[numClusters], r[0]);
+			__m128 vBest = _mm_setzero_ps();
+			for (int y = 1; y < numClusters; y++)
+			{
+				__m128 v = _mm_set_ps(r[3 * numClusters + y], r[2 * numClusters + y], r[numClusters + y], r[y]);
+				__m128 less = _mm_cmplt_ps(v, vMin);
+				vMin = _mm_min_ps(v, vMin);
+				vBest = _mm_or_ps(_mm_and_ps(less, _mm_set1_ps((float)y)), _mm_andnot_ps(less, vBest));
+			}
+			float fBest[4];
+			_mm_storeu_ps(fBest, vBest);
+			_mm_storeu_ps(minRatio, vMin);
+			for (int k = 0; k < 4; k++)
+			{
+				int x = (i + k) / numViews, z = (i + k) % numViews;
+				best[k] = (int)fBest[k];
+				if (assignments[x][z] != best[k])
+					changed++;
+				assignments[x][z] = best[k];
+				minRatios[x][z] = minRatio[k];
+			}
+		}
+#endif
+		for (; i < end; i++)
+		{
+			const float *r = pfRatios + (size_t)i * numClusters;
+			best[0] = 0;
+			for (int y = 1; y < numClusters; y++)
+			{
+				if (r[y] < r[best[0]])
+					best[0] = y;
+			}
+			int x = i / numViews, z = i % numViews;
+			if (assignments[x][z] != best[0])
+				changed++;
+			assignments[x][z] = best[0];
+			minRatios[x][z] = r[best[0]];
+		}
+		blockChanged[block] = changed;
+	});
+	int changed = 0;
+	for (int block = 0; block < numBlocks; block++)
+		changed += blockChanged[block];
+	return changed;
+}
+
+// moveClusterMean
+bool moveClusterMean(PatchId *clusterMean, int clusterId, Vector ** pvFramesPatchesPositions, Vector * pvCameraPosiitons, int ** assignments, float ** minRatios, int numPatches, int numViews, int numFrames,
+	const OrderingEvaluator &evaluate, int *piScratch)
+{
+	int i, j;
+	bool bMalloc = false;
+	bool moved = false;
+	if (piScratch == NULL)
+	{
+		int iScratchSize = (numFrames*numViews * 3 + numPatches * 3)* sizeof(int);
+		piScratch = (int *)malloc(iScratchSize);
+		memset(piScratch, 0, iScratchSize);
+		bMalloc = true;
+	}
+	int *piScratchBase = piScratch;
+	clusterAssign * cluster = (clusterAssign*)piScratch;
+	piScratch += 2 * numFrames*numViews;
+	float * newRatios = (float *)piScratch;
+	piScratch += numFrames*numViews;
+	patchSort * viewToPatch = (patchSort *)piScratch;
+	piScratch += numPatches * 2;
+	PatchId * newMean = (PatchId *)piScratch;
+	piScratch += (numPatches + 1) / 2;
+
+	int count = 0; float avgRatio = 0;
+	for (i = 0; i < numFrames; i++)
+	{
+		for (j = 0; j < numViews; j++)
+		{
+			if (assignments[i][j] == clusterId)
+			{
+				
+				cluster[count].frameId = i;
+				cluster[count].viewId = j;
+				avgRatio += minRatios[i][j];
+				count++;
+			}
+		}
+	}
+
+	// an empty cluster keeps its mean
+	if (count > 0)
+	{
+		avgRatio /= count;
+
+		int frameId, viewId;
+		for (i = 0; i < numPatches; i++)
+		{
+			viewToPatch[i].id = i;
+		}
+		for (i = 0; i < count; i++)
+		{
+			frameId = cluster[i].frameId;
+			viewId = cluster[i].viewId;
+			for (j = 0; j < numPatches; j++)
+			{
+				viewToPatch[j].dist += dist(pvCameraPosiitons[viewId], pvFramesPatchesPositions[frameId][j]);
+			}
+		}
+		std::sort(viewToPatch, viewToPatch + numPatches, sortfunc);
+		for (i = 0; i < numPatches; i++)
+		{
+			newMean[i] = (PatchId)viewToPatch[i].id;
+		}
+
+		// the distance order of the members only replaces the mean if it lowers their overdraw
+		evaluate(newMean, cluster, count, newRatios);
+		float newRatio = 0;
+		for (i = 0; i < count; i++)
+		{
+			newRatio += newRatios[i];
+		}
+		newRatio /= count;
+		if (newRatio < avgRatio && memcmp(clusterMean, newMean, numPatches * sizeof(PatchId)) != 0)
+		{
+			moved = true;
+			// copy the new mean to old Mean
+			memcpy(clusterMean, newMean, numPatches * sizeof(PatchId));
+		}
+	}
+
+	if (piScratch - piScratchBase > 0)
+	{
+		memset(piScratchBase, 0, (piScratch - piScratchBase) * sizeof(int));
+	}
+	if (bMalloc)
+	{
+		free(piScratchBase);
+	}
+
+	return moved;
+}
+// moveMeans
+bool moveMeans(PatchId ** means, Vector  ** pvFramesPatchesPositions, Vector * pvCameraPositions, int ** assignments, float ** minRatios, int numClusters, int numPatches, int numViews, int numFrames,
+	const OrderingEvaluator &evaluate, ThreadPool *pool, bool *pbClusterMoved)
+{
+	std::vector<char> clusterMoved(numClusters, 0);
+	// every cluster gets its own scratch
+	parallelFor(pool, 0, numClusters, [&](int clusterId) {
+		clusterMoved[clusterId] = moveClusterMean(means[clusterId], clusterId, pvFramesPatchesPositions, pvCameraPositions, assignments, minRatios, numPatches, numViews, numFrames, evaluate, NULL);
+	});
+	bool moved = false;
+	for (int clusterId = 0; clusterId < numClusters; clusterId++)
+	{
+		if (clusterMoved[clusterId])
+		{
+			moved = true;
+		}
+		if (pbClusterMoved != NULL)
+		{
+			pbClusterMoved[clusterId] = clusterMoved[clusterId] != 0;
+		}
+	}
+	return moved;
+}
+
+// ratios of the flagged means at every (frame, view), [frame][view][mean]
+static void evaluateMeans(PatchId ** means, const bool *pbEvaluate, int numClusters, const std::vector<clusterAssign> &pairs, const OrderingEvaluator &evaluate,
+	float *pfRatios, ThreadPool *pool)
+{
+	parallelFor(pool, 0, numClusters, [&](int clusterId) {
+		if (!pbEvaluate[clusterId])
+			return;
+		std::vector<float> ratios(pairs.size());
+		evaluate(means[clusterId], &pairs[0], (int)pairs.size(), &ratios[0]);
+		for (size_t i = 0; i < pairs.size(); i++)
+			pfRatios[i * numClusters + clusterId] = ratios[i];
+	});
+}
+
+int clusterMeans(PatchId ** means, int numClusters, int numPatches, Vector ** pvFramesPatchesPositions, Vector * pvCameraPositions, int numFrames, int numViews,
+	const OrderingEvaluator &evaluate, int maxIterations, double maxSeconds, int ** assignments, float ** minRatios, ThreadPool *pool)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<clusterAssign> pairs(numFrames * numViews);
+	for (int i = 0; i < numFrames * numViews; i++)
+	{
+		pairs[i].frameId = i / numViews;
+		pairs[i].viewId = i % numViews;
+	}
+	for (int i = 0; i < numFrames; i++)
+		for (int j = 0; j < numViews; j++)
+			assignments[i][j] = -1;
+	std::vector<float> ratios(pairs.size() * numClusters);
+	bool *pbEvaluate = new bool[numClusters];
+	for (int clusterId = 0; clusterId < numClusters; clusterId++)
+		pbEvaluate[clusterId] = true;
+
+	int iteration = 0;
+	for (;;)
+	{
+		std::chrono::steady_clock::time_point iterationStart = std::chrono::steady_clock::now();
+		evaluateMeans(means, pbEvaluate, numClusters, pairs, evaluate, &ratios[0], pool);
+		int changed = makeAssignment(&ratios[0], assignments, minRatios, numFrames, numViews, numClusters, pool);
+		double objective = 0;
+		for (int i = 0; i < numFrames; i++)
+			for (int j = 0; j < numViews; j++)
+				objective += minRatios[i][j];
+		objective /= pairs.size();
+
+		int numMoved = 0;
+		bool stop = changed == 0 && iteration > 0;
+		stop = stop || iteration >= maxIterations || std::chrono::duration<double>(iterationStart - start).count() >= maxSeconds;
+		if (!stop && moveMeans(means, pvFramesPatchesPositions, pvCameraPositions, assignments, minRatios, numClusters, numPatches, numViews, numFrames, evaluate, pool, pbEvaluate))
+			numMoved = (int)std::count(pbEvaluate, pbEvaluate + numClusters, true);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - iterationStart).count();
+		std::cout << "iteration " << iteration << ": overdraw " << objective << ", " << changed << " assignments changed, " << numMoved
+			<< " means moved, " << seconds << "s" << std::endl;
+		// with no mean moved the next assignment would be the same
+		if (stop || numMoved == 0)
+			break;
+		iteration++;
+	}
+	delete[] pbEvaluate;
+	return iteration;
+}
+
+int clusterMeansMiniBatch(PatchId ** means, int numClusters, int numPatches, Vector ** pvFramesPatchesPositions, Vector * pvCameraPositions, int numFrames,
+	int numViews, const OrderingEvaluator &evaluate, int batchSize, int maxBatchSize, float batchGrowth, int maxIterations, double maxSeconds,
+	unsigned int seed, int ** assignments, float ** minRatios, ThreadPool *pool)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int numPairs = numFrames * numViews;
+	maxBatchSize = std::min(std::max(maxBatchSize, 1), numPairs);
+	batchSize = std::min(std::max(batchSize, 1), maxBatchSize);
+	// running sum of the patch distances of every pair ever assigned to a cluster, its distance order is the mean
+	std::vector<double> distanceSums((size_t)numClusters * numPatches, 0.0);
+	bool *pbAll = new bool[numClusters];
+	for (int clusterId = 0; clusterId < numClusters; clusterId++)
+		pbAll[clusterId] = true;
+	unsigned int state = seed * 2654435761u + 1u;
+
+	int iteration = 0;
+	for (;;)
+	{
+		std::chrono::steady_clock::time_point iterationStart = std::chrono::steady_clock::now();
+		// uniform (frame, view) pairs, with repeats
+		std::vector<clusterAssign> batch(batchSize);
+		for (int i = 0; i < batchSize; i++)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			int pair = (int)(state % (unsigned int)numPairs);
+			batch[i].frameId = pair / numViews;
+			batch[i].viewId = pair % numViews;
+		}
+		std::vector<float> ratios((size_t)batchSize * numClusters);
+		evaluateMeans(means, pbAll, numClusters, batch, evaluate, &ratios[0], pool);
+		std::vector<int> batchAssignments(batchSize, -1);
+		std::vector<float> batchMinRatios(batchSize);
+		int *piBatchAssignments = &batchAssignments[0];
+		float *pfBatchMinRatios = &batchMinRatios[0];
+		makeAssignment(&ratios[0], &piBatchAssignments, &pfBatchMinRatios, 1, batchSize, numClusters, pool);
+		double objective = 0;
+		for (int i = 0; i < batchSize; i++)
+			objective += batchMinRatios[i];
+		objective /= batchSize;
+
+		// every cluster takes in its batch members and tries the distance order of its sums on them
+		std::vector<char> clusterMoved(numClusters, 0);
+		parallelFor(pool, 0, numClusters, [&](int clusterId) {
+			std::vector<clusterAssign> members;
+			float avgRatio = 0.f;
+			double *sums = &distanceSums[(size_t)clusterId * numPatches];
+			for (int i = 0; i < batchSize; i++)
+			{
+				if (batchAssignments[i] != clusterId)
+					continue;
+				members.push_back(batch[i]);
+				avgRatio += batchMinRatios[i];
+				for (int j = 0; j < numPatches; j++)
+					sums[j] += dist(pvCameraPositions[batch[i].viewId], pvFramesPatchesPositions[batch[i].frameId][j]);
+			}
+			if (members.empty())
+				return;
+			avgRatio /= members.size();
+			std::vector<patchSort> viewToPatch(numPatches);
+			for (int j = 0; j < numPatches; j++)
+			{
+				viewToPatch[j].dist = (float)sums[j];
+				viewToPatch[j].id = j;
+			}
+			std::sort(viewToPatch.begin(), viewToPatch.end(), sortfunc);
+			std::vector<PatchId> newMean(numPatches);
+			for (int j = 0; j < numPatches; j++)
+				newMean[j] = (PatchId)viewToPatch[j].id;
+			std::vector<float> newRatios(members.size());
+			evaluate(&newMean[0], &members[0], (int)members.size(), &newRatios[0]);
+			float newRatio = 0.f;
+			for (size_t i = 0; i < members.size(); i++)
+				newRatio += newRatios[i];
+			newRatio /= members.size();
+			if (newRatio < avgRatio && memcmp(means[clusterId], &newMean[0], numPatches * sizeof(PatchId)) != 0)
+			{
+				memcpy(means[clusterId], &newMean[0], numPatches * sizeof(PatchId));
+				clusterMoved[clusterId] = 1;
+			}
+		});
+		int numMoved = (int)std::count(clusterMoved.begin(), clusterMoved.end(), 1);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - iterationStart).count();
+		std::cout << "batch " << iteration << ": " << batchSize << " pairs, overdraw " << objective << ", " << numMoved << " means moved, "
+			<< seconds << "s" << std::endl;
+
+		iteration++;
+		// a full size batch that moves nothing: the sums only change by sampling noise from here on
+		if ((numMoved == 0 && batchSize == maxBatchSize) || iteration >= maxIterations ||
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= maxSeconds)
+			break;
+		batchSize = std::min(maxBatchSize, std::max(batchSize + 1, (int)(batchSize * batchGrowth)));
+	}
+
+	// the one pass over all pairs, skipped without assignments; all means are scored on a block before the next
+	if (assignments != NULL)
+	{
+		std::vector<float> ratios((size_t)numPairs * numClusters);
+		std::vector<clusterAssign> pairs;
+		for (int first = 0; first < numPairs; first += maxBatchSize)
+		{
+			pairs.resize(std::min(maxBatchSize, numPairs - first));
+			for (int i = 0; i < (int)pairs.size(); i++)
+			{
+				pairs[i].frameId = (first + i) / numViews;
+				pairs[i].viewId = (first + i) % numViews;
+			}
+			evaluateMeans(means, pbAll, numClusters, pairs, evaluate, &ratios[(size_t)first * numClusters], pool);
+		}
+		makeAssignment(&ratios[0], assignments, minRatios, numFrames, numViews, numClusters, pool);
+	}
+	delete[] pbAll;
+	return iteration;
+}
+
+int chooseNumClusters(PatchId ** means, int * pickIds, int maxClusters, float targetOverdraw, long long bytesPerOrdering, long long maxIndexBytes,
+	int numPatches, Vector ** pvFramesPatchesPositions, float * pfCameraPositions, Vector * pvCameraPositions, int numFrames, int numViews,
+	const OrderingEvaluator &evaluate, int maxIterations, double maxSeconds, int ** assignments, float ** minRatios,
+	std::vector<ClusterCountPoint> *curve, ThreadPool *pool)
+{
+	std::vector<ClusterCountPoint> points;
+	int chosen = 0;
+	// the views are seeded once for the largest K that fits, with maxClusters as the bound, so every K starts from
+	// the first K of them
+	int numSeeds = maxClusters;
+	if (maxIndexBytes > 0 && bytesPerOrdering > 0 && maxIndexBytes / bytesPerOrdering < numSeeds)
+		numSeeds = (int)(maxIndexBytes / bytesPerOrdering);
+	if (numSeeds > 0)
+		seedViews(pvFramesPatchesPositions, numFrames, numPatches, pfCameraPositions, numViews, numSeeds, maxClusters, 1, pickIds, pool);
+	for (int numClusters = 1; numClusters <= numSeeds; numClusters++)
+	{
+		std::cout << "clusters " << numClusters << ":" << std::endl;
+		initMeans(means, pvFramesPatchesPositions, numFrames, numClusters, numPatches, pickIds, pfCameraPositions, NULL);
+		ClusterCountPoint point;
+		point.numClusters = numClusters;
+		point.iterations = clusterMeans(means, numClusters, numPatches, pvFramesPatchesPositions, pvCameraPositions, numFrames, numViews, evaluate,
+			maxIterations, maxSeconds, assignments, minRatios, pool);
+		double overdraw = 0.0;
+		for (int i = 0; i < numFrames; i++)
+			for (int j = 0; j < numViews; j++)
+				overdraw += minRatios[i][j];
+		point.overdraw = (float)(overdraw / ((double)numFrames * numViews));
+		point.indexBytes = numClusters * bytesPerOrdering;
+		points.push_back(point);
+		if (targetOverdraw > 0.f && point.overdraw <= targetOverdraw)
+		{
+			chosen = numClusters;
+			break;
+		}
+	}
+
+	// no K met the target: the lowest overdraw that fits, rerun unless it was the last one
+	if (chosen == 0 && !points.empty())
+	{
+		size_t best = 0;
+		for (size_t i = 1; i < points.size(); i++)
+		{
+			if (points[i].overdraw < points[best].overdraw)
+				best = i;
+		}
+		chosen = points[best].numClusters;
+		if (best + 1 != points.size())
+		{
+			std::cout << "clusters " << chosen << " again:" << std::endl;
+			initMeans(means, pvFramesPatchesPositions, numFrames, chosen, numPatches, pickIds, pfCameraPositions, NULL);
+			clusterMeans(means, chosen, numPatches, pvFramesPatchesPositions, pvCameraPositions, numFrames, numViews, evaluate,
+				maxIterations, maxSeconds, assignments, minRatios, pool);
+		}
+	}
+
+	jobPrintf("%8s %10s %14s %10s\n", "clusters", "overdraw", "index bytes", "iterations");
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		jobPrintf("%8d %10.4f %14lld %10d%s\n", points[i].numClusters, points[i].overdraw, points[i].indexBytes, points[i].iterations,
+			points[i].numClusters == chosen ? "  <-" : "");
+	}
+	if (chosen == 0)
+		jobPrintf("ERROR: not even one ordering of %lld bytes fits in %lld bytes\n", bytesPerOrdering, maxIndexBytes);
+	if (curve != NULL)
+		*curve = points;
+	return chosen;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "patchOrder.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <vector>
+
+class ThreadPool;
+
+// CPU side of the triangle ordering: the vcache/overdraw clustering of FanVertCluster (after AMD Tootle),
+// the per frame patch positions and the view dependent patch orderings built from them.
+// Nothing here needs a GL context.
+
+class Vector
+{
+public:
+	float v[3];
+	Vector() {}
+	Vector(float a, float b, float c) { v[0] = a; v[1] = b; v[2] = c; }
+	Vector(float *a) { v[0] = a[0]; v[1] = a[1]; v[2] = a[2]; }
+	void operator+=(const Vector a) { v[0] += a.v[0]; v[1] += a.v[1]; v[2] += a.v[2]; }
+	void operator-=(const Vector a) { v[0] -= a.v[0]; v[1] -= a.v[1]; v[2] -= a.v[2]; }
+	Vector operator+(const Vector a) { return Vector(v[0] + a.v[0], v[1] + a.v[1], v[2] + a.v[2]); }
+	Vector operator-(const Vector a) { return Vector(v[0] - a.v[0], v[1] - a.v[1], v[2] - a.v[2]); }
+	Vector operator/(const float n) { return Vector(v[0] / n, v[1] / n, v[2] / n); }
+	void operator/=(const int n) { v[0] /= (float)n; v[1] /= (float)n; v[2] /= (float)n; }
+	void operator/=(const float n) { v[0] /= n; v[1] /= n; v[2] /= n; }
+	Vector operator*(const float a) { return Vector(v[0] * a, v[1] * a, v[2] * a); }
+	Vector operator*(const Vector a) { return Vector(v[0] * a.v[0], v[1] * a.v[1], v[2] * a.v[2]); }
+	Vector operator/(const Vector a) { return Vector(v[0] / a.v[0], v[1] / a.v[1], v[2] / a.v[2]); }
+	float length() { float w = v[0] * v[0] + v[1] * v[1] + v[2] * v[2]; return w > 0.f ? sqrtf(w) : 0.f; }
+	void normalize() { float w = v[0] * v[0] + v[1] * v[1] + v[2] * v[2]; if (w > 0.f) *this /= sqrtf(w); }
+};
+
+inline float dot(const Vector a, const Vector b)
+{
+	return (a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2]);
+}
+
+inline Vector cross(const Vector a, const Vector b)
+{
+	return Vector(a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0]);
+}
+inline float dist(const Vector a, const Vector b)
+{
+	Vector c = Vector(a);
+	return (c - b).length();
+}
+
+// structure used to sort patches
+class patchSort
+{
+public:
+	float dist;// distance
+	int id;//index
+};
+class clusterAssign
+{
+public:
+	int frameId;
+	int viewId;
+};
+
+// overdraw ratio of one patch ordering at each of numMembers (frame, view) pairs, e.g. from the coverage cache
+// (coverageRatios), ray samples or the GL evaluation
+typedef std::function<void(const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios)> OrderingEvaluator;
+inline bool sortfunc(const patchSort &a, const patchSort &b)
+{
+	return a.dist < b.dist;
+}
+
+//function that computes size of scratch memory
+int FanVertScratchSize(int iNumVertices, int iNumFaces);
+
+//function that implements the vcache optimization
+float FanVertLinSort(int *piIndexBufferIn, int *piIndexBufferOut, int iNumFaces, int *piScratch, int iCacheSize, int *piClustersOut, int &iNumClusters);
+
+//function that implements the linear cutting
+int OverdrawOrderPartition(int *piIndexBufferIn,
+	int iNumFaces,
+	int iNumVertices,
+	int *piClustersIn, //should have piClustersIn[iNumClusters] == iNumFaces
+	int iNumClustersIn,
+	int iCacheSize,
+	float lambda,
+	int *piClustersOut,
+	int *piScratch);   //needs VCacheSimScratchSize(VCACHE_FIFO, iNumVertices) ints
+
+// function implements the linear sorting
+// output the linearFace(piIndexBufferOut), iNumColusters, piClustersOut (set patches)
+void FanVertCluster(float *pfVertexPositionsIn,   //vertex buffer positions, 3 floats per vertex
+	int *piIndexBufferIn,         //index buffer positions, 3 ints per vertex
+	int *piIndexBufferOut,        //updated index buffer (the output of the algorithm)
+	int iNumVertices,             //# of vertices in the vertex buffer
+	int iNumFaces,                //# of faces in the index buffer
+	int iCacheSize,               //hardware cache size
+	float alpha,                  //constant parameter to compute lambda term from algorithm 
+	int *piScratch = NULL,        //optional temp buffer for computations; its size in bytes should be FanVertScratchSize
+	int *piClustersOut = NULL,    //optional buffer for the output cluster position (in faces) of each cluster
+	int *piNumClustersOut = NULL); //the number of putput clusters
+
+//function that implements getting patches positions
+void pvPatchesPostions(int *piIndexBufferIn,
+	int iNumFaces,
+	float *pfVertexPositionsIn,
+	int iNumVertices,
+	int *piClustersIn,
+	int iNumClusters,
+	Vector * pvPatchesPositions,
+	int *piScratch);
+
+// streaming version of pvPatchesPostions over a whole animation: only two frames of vertices are resident,
+// frame i+1 is produced by loadFrame (text file or skinning) while frame i is reduced to its patch positions
+bool streamPatchesPositions(const std::function<bool(int, float *)> &loadFrame,
+	int numFrames,
+	int iNumVertices,
+	int *piIndexBufferIn,
+	int iNumFaces,
+	int *piClustersIn,
+	int iNumClusters,
+	Vector ** pvFramesPatchesPositions,
+	ThreadPool *pool);
+
+// function that implements rank patches from near to far, the ordering is written as a patch permutation
+void depthSortPatch(Vector viewpoint, Vector * pvAvgPatchesPositions, int numPatches, PatchId * pusPatchOrderOut);
+
+// function that implements the initializition
+void initMeans(PatchId ** means, Vector ** pvFramesPatchesPositions, int numFrames, int numClusters, int numPatches, int * pickIds, float * pfCameraPositions, int * piScratch);
+
+// Kendall tau distance of two orders of the same patches, the number of pairs they rank differently;
+// piScratch (may be NULL) needs numPatches * 3 ints
+long long kendallTauDistance(const PatchId *pusOrderA, const PatchId *pusOrderB, int numPatches, int *piScratch);
+
+// picks the numClusters views of initMeans with greedy k-means++: every view is represented by its distance order
+// of the frame-averaged patch positions (the order initMeans would make of it), the first view is drawn uniformly,
+// then 2 + log(maxClusters) candidates are drawn with a probability proportional to the squared Kendall tau
+// distance to the nearest pick and the one leaving the smallest sum of squared distances is taken. The number of
+// candidates only depends on the bound maxClusters (>= numClusters), so with the same seed and bound the picks
+// for fewer clusters are the first ones of the picks for more
+void seedViews(Vector ** pvFramesPatchesPositions, int numFrames, int numPatches, const float * pfCameraPositions, int numViews, int numClusters,
+	int maxClusters, unsigned int seed, int * pickIds, ThreadPool *pool);
+
+// function that implements the assignments: every (frame, view) goes to the mean with the lowest ratio in
+// pfRatios ([frame][view][cluster]), the first one on ties; blocks of pairs are spread over the pool (may be NULL)
+// and each block takes the argmin of 4 pairs at once with SSE; returns the number of assignments that changed
+int makeAssignment(const float *pfRatios, int **assignments, float **minRatios, int numFrames, int numViews, int numClusters, ThreadPool *pool = NULL);
+
+// moveClusterMean: the distance order of the cluster members replaces the mean if it lowers their mean ratio;
+// piScratch (may be NULL) needs (numFrames*numViews*3 + numPatches*3) ints
+bool moveClusterMean(PatchId *clusterMean, int clusterId, Vector ** pvFramesPatchesPositions, Vector * pvCameraPosiitons, int ** assignments, float ** minRatios, int numPatches, int numViews, int numFrames,
+	const OrderingEvaluator &evaluate, int *piScratch);
+
+// moveMeans: all clusters at once over the pool; pbClusterMoved (optional, numClusters) tells which ones moved
+bool moveMeans(PatchId ** means, Vector  ** pvFramesPatchesPositions, Vector * pvCameraPositions, int ** assignments, float ** minRatios, int numClusters, int numPatches, int numViews, int numFrames,
+	const OrderingEvaluator &evaluate, ThreadPool *pool, bool *pbClusterMoved = NULL);
+
+// Lloyd iterations from the current means: assign, then move every mean, until no assignment changes, no mean
+// moves, maxIterations or maxSeconds; prints the mean overdraw and the time of every iteration and returns the
+// number of mean updates
+int clusterMeans(PatchId ** means, int numClusters, int numPatches, Vector ** pvFramesPatchesPositions, Vector * pvCameraPositions, int numFrames, int numViews,
+	const OrderingEvaluator &evaluate, int maxIterations, double maxSeconds, int ** assignments, float ** minRatios, ThreadPool *pool);
+
+// mini-batch variant of clusterMeans for many frames and views: every iteration scores the means on batchSize
+// uniformly drawn (frame, view) pairs only and assigns them; every cluster keeps a running sum of the patch
+// distances of all pairs it was given and its distance order replaces the mean if it lowers the overdraw of the
+// cluster's batch pairs. The batch grows by batchGrowth up to maxBatchSize, and it stops once a maxBatchSize batch
+// moves no mean, or at maxIterations / maxSeconds. assignments and minRatios (may be NULL, then the pass is
+// skipped) are filled by one final pass over all pairs, in blocks of maxBatchSize pairs so that an evaluator keeping
+// the coverage of maxBatchSize pairs (a LazyCoverageCache) rasterizes every pair once. Returns the number of batches
+int clusterMeansMiniBatch(PatchId ** means, int numClusters, int numPatches, Vector ** pvFramesPatchesPositions, Vector * pvCameraPositions, int numFrames,
+	int numViews, const OrderingEvaluator &evaluate, int batchSize, int maxBatchSize, float batchGrowth, int maxIterations, double maxSeconds,
+	unsigned int seed, int ** assignments, float ** minRatios, ThreadPool *pool);
+
+// one point of the overdraw against number of orderings curve
+struct ClusterCountPoint
+{
+	int numClusters;
+	float overdraw;        // mean over the (frame, view) pairs of their best ordering
+	long long indexBytes;  // numClusters * bytesPerOrdering
+	int iterations;
+};
+
+// sweeps the number of orderings K = 1, 2, ... maxClusters, each with initMeans from the first K views of one
+// seedViews for maxClusters and clusterMeans, and stops at the first K whose overdraw is at most targetOverdraw (<= 0: no target) or before the K orderings of
+// bytesPerOrdering each exceed maxIndexBytes (<= 0: no budget). Returns the smallest K that meets the target, else
+// the K of the lowest overdraw within the budget (0 if none fits), with its means (maxClusters rows), pickIds,
+// assignments and minRatios; the curve is printed and copied to curve (may be NULL)
+int chooseNumClusters(PatchId ** means, int * pickIds, int maxClusters, float targetOverdraw, long long bytesPerOrdering, long long maxIndexBytes,
+	int numPatches, Vector ** pvFramesPatchesPositions, float * pfCameraPositions, Vector * pvCameraPositions, int numFrames, int numViews,
+	const OrderingEvaluator &evaluate, int maxIterations, double maxSeconds, int ** assignments, float ** minRatios,
+	std::vector<ClusterCountPoint> *curve, ThreadPool *pool);
+
+// malloc 2 dimension array
+template <typename T>
+T** new_Array2D(int row, int col)
+{
+	size_t size = sizeof(T);
+	size_t point_size = sizeof(T*);
+	// row pointers followed by the rows, one block freed with one free
+	T **arr = (T **)malloc(point_size * row + size * row * col);
+	if (arr != NULL)
+	{
+		T *head = (T*)((char *)arr + point_size * row);
+		for (int i = 0; i < row; ++i)
+		{
+			arr[i] = (T*)((char *)head + i * col * size);
+			for (int j = 0; j < col; ++j)
+				new (&arr[i][j]) T;
+		}
+	}
+	return (T**)arr;
+}
+//release
+template <typename T>
+void delete_Array2D(T **arr, int row, int col)
+{
+	if (arr == NULL)
+		return;
+	for (int i = 0; i < row; ++i)
+		for (int j = 0; j < col; ++j)
+			arr[i][j].~T();
+	free((void**)arr);
+}
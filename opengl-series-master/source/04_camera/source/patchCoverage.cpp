@@ -0,0 +1,247 @@
+#include "patchCoverage.h"
+#include "ordering.h"
+#include "softRaster.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+// collects the fragments of the triangles of one patch
+struct CoverageCollector
+{
+	int iWidth;
+	std::vector<CoverageFragment> *fragments;
+	void operator()(int x, int y, float z)
+	{
+		CoverageFragment f = { y * iWidth + x, z };
+		fragments->push_back(f);
+	}
+};
+
+static bool fragmentPixelLess(const CoverageFragment &a, const CoverageFragment &b)
+{
+	return a.pixel < b.pixel;
+}
+
+void appendPatchRuns(PatchCoverage *coverage, int patchId, const CoverageFragment *fragments, int numFragments, char *pbShown)
+{
+	for (int i = 0; i < numFragments;)
+	{
+		CoverageRun run;
+		run.pixel = fragments[i].pixel;
+		run.numDepths = 0;
+		// nothing at or behind the far plane passes against the cleared depth, nor anything behind an earlier
+		// fragment of the same patch
+		float last = 1.f;
+		for (; i < numFragments && fragments[i].pixel == run.pixel; i++)
+		{
+			if (fragments[i].z < last)
+			{
+				last = fragments[i].z;
+				coverage->depths.push_back(last);
+				run.numDepths++;
+			}
+		}
+		if (run.numDepths > 0)
+		{
+			coverage->runs.push_back(run);
+			pbShown[run.pixel] = 1;
+		}
+	}
+	coverage->patchRuns[patchId + 1] = (int)coverage->runs.size();
+	coverage->patchDepths[patchId + 1] = (int)coverage->depths.size();
+}
+
+void buildPatchCoverage(const float *pfVertexPositions, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfViewMatrix, int iWidth, int iHeight, PatchCoverage *coverage)
+{
+	std::vector<RasterTriangle> triangles;
+	setupViewTriangles(pfVertexPositions, iNumVertices, piIndexBufferIn, iNumFaces, pfViewMatrix, iWidth, iHeight, triangles);
+
+	int numPixels = iWidth * iHeight;
+	coverage->numPatches = numPatches;
+	coverage->numPixels = numPixels;
+	coverage->patchRuns.assign(numPatches + 1, 0);
+	coverage->patchDepths.assign(numPatches + 1, 0);
+	coverage->runs.clear();
+	coverage->depths.clear();
+	std::vector<char> shown(numPixels, 0);
+	std::vector<CoverageFragment> fragments;
+	CoverageCollector collect;
+	collect.iWidth = iWidth;
+	collect.fragments = &fragments;
+	size_t t = 0;
+	for (int patchId = 0; patchId < numPatches; patchId++)
+	{
+		// triangles stay in face order, a face cut by the near plane gives two in a row
+		fragments.clear();
+		for (; t < triangles.size() && triangles[t].face < piClustersIn[patchId + 1]; t++)
+			rasterizeTriangle(triangles[t], 0, 0, iWidth, iHeight, collect);
+		std::stable_sort(fragments.begin(), fragments.end(), fragmentPixelLess);
+		appendPatchRuns(coverage, patchId, fragments.empty() ? NULL : &fragments[0], (int)fragments.size(), &shown[0]);
+	}
+	coverage->runs.shrink_to_fit();
+	coverage->depths.shrink_to_fit();
+	coverage->shownPixels = 0;
+	for (int i = 0; i < numPixels; i++)
+		coverage->shownPixels += shown[i];
+}
+
+int patchOrderDrawnPixels(const PatchCoverage *coverage, const PatchId *pusPatchOrder, float *pfDepth, int *piPixelDrawn)
+{
+	for (int i = 0; i < coverage->numPixels; i++)
+		pfDepth[i] = 1.f;
+	if (piPixelDrawn != NULL)
+		memset(piPixelDrawn, 0, coverage->numPixels * sizeof(int));
+	if (coverage->runs.empty())
+		return 0;
+	const CoverageRun *runs = &coverage->runs[0];
+	const float *depths = &coverage->depths[0];
+	int drawn = 0;
+	for (int k = 0; k < coverage->numPatches; k++)
+	{
+		int patchId = pusPatchOrder[k];
+		const float *d = depths + coverage->patchDepths[patchId];
+		for (int r = coverage->patchRuns[patchId]; r < coverage->patchRuns[patchId + 1]; r++)
+		{
+			// the depths that pass are the tail of the run below the depth in the pixel
+			int n = runs[r].numDepths, m = n;
+			float current = pfDepth[runs[r].pixel];
+			while (m > 0 && d[m - 1] < current)
+				m--;
+			if (m < n)
+			{
+				drawn += n - m;
+				pfDepth[runs[r].pixel] = d[n - 1];
+				if (piPixelDrawn != NULL)
+					piPixelDrawn[runs[r].pixel] += n - m;
+			}
+			d += n;
+		}
+	}
+	return drawn;
+}
+
+float patchOrderRatio(const PatchCoverage *coverage, const PatchId *pusPatchOrder, float *pfDepth)
+{
+	if (coverage->shownPixels == 0)
+		return 0.f;
+	std::vector<float> depth;
+	if (pfDepth == NULL)
+	{
+		depth.resize(coverage->numPixels);
+		pfDepth = &depth[0];
+	}
+	return (float)patchOrderDrawnPixels(coverage, pusPatchOrder, pfDepth) / coverage->shownPixels;
+}
+
+void buildCoverageCache(float **pfFramesVertexPositions, int numFrames, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfCameraPositions, int numViews, int iWidth, int iHeight, CoverageCache *cache, ThreadPool *pool)
+{
+	cache->numFrames = numFrames;
+	cache->numViews = numViews;
+	cache->numPixels = iWidth * iHeight;
+	cache->coverage.clear();
+	cache->coverage.resize(numFrames * numViews);
+	if (numViews <= 0)
+		return;
+	std::vector<float> viewMatrices(numViews * 16);
+	buildViewMatrices(pfCameraPositions, numViews, (float)iWidth / iHeight, &viewMatrices[0]);
+	parallelFor(pool, 0, numFrames * numViews, [&](int i) {
+		int frameId = i / numViews, viewId = i % numViews;
+		buildPatchCoverage(pfFramesVertexPositions[frameId], iNumVertices, piIndexBufferIn, piClustersIn, numPatches, iNumFaces,
+			&viewMatrices[viewId * 16], iWidth, iHeight, &cache->coverage[i]);
+	});
+}
+
+void coverageRatios(const CoverageCache *cache, const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios,
+	ThreadPool *pool)
+{
+	// chunks of members share one depth buffer
+	const int chunk = 64;
+	parallelFor(pool, 0, (numMembers + chunk - 1) / chunk, [&](int c) {
+		std::vector<float> depth(cache->numPixels);
+		for (int i = c * chunk; i < numMembers && i < (c + 1) * chunk; i++)
+			pfRatios[i] = patchOrderRatio(coverageAt(cache, members[i].frameId, members[i].viewId), pusPatchOrder, &depth[0]);
+	});
+}
+
+void initLazyCoverageCache(float **pfFramesVertexPositions, int numFrames, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfCameraPositions, int numViews, int iWidth, int iHeight, int maxEntries, LazyCoverageCache *cache)
+{
+	cache->pfFramesVertexPositions = pfFramesVertexPositions;
+	cache->numFrames = numFrames;
+	cache->iNumVertices = iNumVertices;
+	cache->piIndexBuffer = piIndexBufferIn;
+	cache->piClusters = piClustersIn;
+	cache->numPatches = numPatches;
+	cache->iNumFaces = iNumFaces;
+	cache->numViews = numViews;
+	cache->iWidth = iWidth;
+	cache->iHeight = iHeight;
+	cache->viewMatrices.resize(numViews * 16);
+	if (numViews > 0)
+		buildViewMatrices(pfCameraPositions, numViews, (float)iWidth / iHeight, &cache->viewMatrices[0]);
+	cache->maxEntries = maxEntries > 1 ? maxEntries : 1;
+	cache->numBuilt = 0;
+	cache->recent.clear();
+	cache->entries.clear();
+}
+
+std::shared_ptr<LazyCoverageEntry> lazyCoverageAt(LazyCoverageCache *cache, int frameId, int viewId)
+{
+	int pairId = frameId * cache->numViews + viewId;
+	std::shared_ptr<LazyCoverageEntry> entry;
+	{
+		std::unique_lock<std::mutex> lock(cache->mutex);
+		auto found = cache->entries.find(pairId);
+		if (found != cache->entries.end())
+		{
+			cache->recent.splice(cache->recent.begin(), cache->recent, found->second.second);
+			entry = found->second.first;
+		}
+		else
+		{
+			// a dropped entry is freed by its last holder
+			if (cache->entries.size() >= cache->maxEntries)
+			{
+				cache->entries.erase(cache->recent.back());
+				cache->recent.pop_back();
+			}
+			entry = std::make_shared<LazyCoverageEntry>();
+			cache->recent.push_front(pairId);
+			cache->entries[pairId] = std::make_pair(entry, cache->recent.begin());
+		}
+	}
+	// the other threads that want the pair wait here until it is rasterized, outside the cache lock
+	std::call_once(entry->built, [&]() {
+		buildPatchCoverage(cache->pfFramesVertexPositions[frameId], cache->iNumVertices, cache->piIndexBuffer, cache->piClusters, cache->numPatches,
+			cache->iNumFaces, &cache->viewMatrices[viewId * 16], cache->iWidth, cache->iHeight, &entry->coverage);
+		std::unique_lock<std::mutex> lock(cache->mutex);
+		cache->numBuilt++;
+	});
+	return entry;
+}
+
+void lazyCoverageRatios(LazyCoverageCache *cache, const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios,
+	ThreadPool *pool)
+{
+	const int chunk = 64;
+	parallelFor(pool, 0, (numMembers + chunk - 1) / chunk, [&](int c) {
+		std::vector<float> depth(cache->iWidth * cache->iHeight);
+		for (int i = c * chunk; i < numMembers && i < (c + 1) * chunk; i++)
+			pfRatios[i] = patchOrderRatio(&lazyCoverageAt(cache, members[i].frameId, members[i].viewId)->coverage, pusPatchOrder, &depth[0]);
+	});
+}
+
+long long coverageCacheSize(const CoverageCache *cache)
+{
+	long long size = 0;
+	for (size_t i = 0; i < cache->coverage.size(); i++)
+	{
+		const PatchCoverage &c = cache->coverage[i];
+		size += sizeof(PatchCoverage) + (c.patchRuns.capacity() + c.patchDepths.capacity()) * sizeof(int)
+			+ c.runs.capacity() * sizeof(CoverageRun) + c.depths.capacity() * sizeof(float);
+	}
+	return size;
+}
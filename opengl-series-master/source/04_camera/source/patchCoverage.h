@@ -0,0 +1,125 @@
+#pragma once
+
+#include "patchOrder.h"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+class clusterAssign;
+
+// For one (frame, view) the overdraw of an ordering only depends on the order of the patches, the faces inside a
+// patch are always drawn in the order of the clustered index buffer. The patches are rasterized once (with the
+// softRaster setup) and kept patch major: for every pixel a patch covers, the depths of its fragments that can
+// still pass the depth test after the earlier fragments of the same patch, a strictly decreasing list. With a
+// depth D already in the pixel, the fragments that pass are exactly the ones of that list below D, so any patch
+// permutation is scored by one walk over the runs, without rasterizing again.
+
+// the fragments of one patch at one pixel
+struct CoverageRun
+{
+	int pixel;
+	int numDepths;
+};
+
+struct PatchCoverage
+{
+	int numPatches;
+	int numPixels;
+	int shownPixels;                  // pixels with a fragment in front of the far plane, the same for every order
+	std::vector<int> patchRuns;       // numPatches + 1 offsets into runs
+	std::vector<int> patchDepths;     // numPatches + 1 offsets into depths
+	std::vector<CoverageRun> runs;
+	std::vector<float> depths;        // per run, decreasing
+};
+
+// coverage of every (frame, view), frame major
+struct CoverageCache
+{
+	int numFrames;
+	int numViews;
+	int numPixels;
+	std::vector<PatchCoverage> coverage;
+};
+
+// a fragment of the patch being appended
+struct CoverageFragment
+{
+	int pixel;
+	float z;
+};
+
+// adds the runs of patch patchId (the patches are appended in index order) from its fragments sorted by pixel, in
+// draw order within a pixel; pbShown (numPixels) is set for the pixels that get a run
+void appendPatchRuns(PatchCoverage *coverage, int patchId, const CoverageFragment *fragments, int numFragments, char *pbShown);
+
+// rasterizes the patches of a clustered index buffer (piClustersIn[numPatches] == iNumFaces) for one view
+void buildPatchCoverage(const float *pfVertexPositions, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfViewMatrix, int iWidth, int iHeight, PatchCoverage *coverage);
+
+// fragments that pass the depth test when the patches are drawn in pusPatchOrder; pfDepth holds numPixels floats,
+// piPixelDrawn (optional, numPixels ints) receives the count of every pixel
+int patchOrderDrawnPixels(const PatchCoverage *coverage, const PatchId *pusPatchOrder, float *pfDepth, int *piPixelDrawn = NULL);
+
+// drawn / shown of an ordering, 0 for an empty view; pfDepth may be NULL
+float patchOrderRatio(const PatchCoverage *coverage, const PatchId *pusPatchOrder, float *pfDepth = NULL);
+
+// coverage of all frames and views with the camera of buildViewMatrices, spread over the pool
+void buildCoverageCache(float **pfFramesVertexPositions, int numFrames, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfCameraPositions, int numViews, int iWidth, int iHeight, CoverageCache *cache, ThreadPool *pool);
+
+inline const PatchCoverage *coverageAt(const CoverageCache *cache, int frameId, int viewId)
+{
+	return &cache->coverage[frameId * cache->numViews + viewId];
+}
+
+// ratio of one ordering at numMembers (frame, view) pairs of the cache, an OrderingEvaluator
+void coverageRatios(const CoverageCache *cache, const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios,
+	ThreadPool *pool);
+
+// bytes held by the cache
+long long coverageCacheSize(const CoverageCache *cache);
+
+// one (frame, view) of a LazyCoverageCache, rasterized by the first thread that asks for it
+struct LazyCoverageEntry
+{
+	std::once_flag built;
+	PatchCoverage coverage;
+};
+
+// coverage of the (frame, view) pairs rasterized when they are first asked for, for the mini-batch clustering that
+// only visits a sample of them; at most maxEntries pairs are kept and the least recently used one is dropped first.
+// The frames, index buffer and clusters are not copied and must outlive the cache
+struct LazyCoverageCache
+{
+	float **pfFramesVertexPositions;
+	int numFrames;
+	int iNumVertices;
+	const int *piIndexBuffer;
+	const int *piClusters;
+	int numPatches;
+	int iNumFaces;
+	int numViews;
+	int iWidth;
+	int iHeight;
+	std::vector<float> viewMatrices;
+	size_t maxEntries;
+	long long numBuilt;               // pairs rasterized so far, a pair dropped and asked for again counts twice
+	std::mutex mutex;
+	std::list<int> recent;            // pair ids (frameId * numViews + viewId), most recently used first
+	std::unordered_map<int, std::pair<std::shared_ptr<LazyCoverageEntry>, std::list<int>::iterator> > entries;
+};
+
+void initLazyCoverageCache(float **pfFramesVertexPositions, int numFrames, int iNumVertices, const int *piIndexBufferIn, const int *piClustersIn,
+	int numPatches, int iNumFaces, const float *pfCameraPositions, int numViews, int iWidth, int iHeight, int maxEntries, LazyCoverageCache *cache);
+
+// the coverage of one pair, rasterized now if it is not kept; the entry stays valid while it is held
+std::shared_ptr<LazyCoverageEntry> lazyCoverageAt(LazyCoverageCache *cache, int frameId, int viewId);
+
+// coverageRatios on a LazyCoverageCache, an OrderingEvaluator
+void lazyCoverageRatios(LazyCoverageCache *cache, const PatchId *pusPatchOrder, const clusterAssign *members, int numMembers, float *pfRatios,
+	ThreadPool *pool);
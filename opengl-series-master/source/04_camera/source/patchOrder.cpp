@@ -0,0 +1,133 @@
+#include "patchOrder.h"
+#include "jobLog.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct PatchOrderHeader
+{
+	int magic;
+	int version;
+	int numFaces;
+	int numPatches;
+	int numOrders;
+	int reserved[3];
+};
+
+void expandPatchOrder(const PatchId *pusPatchOrder, int numPatches, const int *piIndexBufferIn, const int *piClustersIn, int *piIndexBufferOut)
+{
+	int *p = piIndexBufferOut;
+	for (int i = 0; i < numPatches; i++)
+	{
+		int patchId = pusPatchOrder[i];
+		int n = (piClustersIn[patchId + 1] - piClustersIn[patchId]) * 3;
+		memcpy(p, piIndexBufferIn + piClustersIn[patchId] * 3, n * sizeof(int));
+		p += n;
+	}
+}
+
+bool writePatchOrders(const char *path, PatchId **pusPatchOrders, int numOrders, int numPatches, const int *piIndexBufferIn, const int *piClustersIn, int numFaces)
+{
+	PatchOrderHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = PATCHORDERMAGIC;
+	header.version = PATCHORDERVERSION;
+	header.numFaces = numFaces;
+	header.numPatches = numPatches;
+	header.numOrders = numOrders;
+
+	FILE * myFile = fopen(path, "wb");
+	if (myFile == NULL)
+	{
+		jobPrintf("ERROR: File cannot be created %s\n", path);
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, myFile) == 1
+		&& fwrite(piClustersIn, sizeof(int), numPatches + 1, myFile) == (size_t)(numPatches + 1)
+		&& fwrite(piIndexBufferIn, sizeof(int), numFaces * 3, myFile) == (size_t)(numFaces * 3);
+	for (int i = 0; ok && i < numOrders; i++)
+	{
+		ok = fwrite(pusPatchOrders[i], sizeof(PatchId), numPatches, myFile) == (size_t)numPatches;
+	}
+	ok = (fclose(myFile) == 0) && ok;
+	if (!ok)
+	{
+		jobPrintf("ERROR: File cannot be written %s\n", path);
+		remove(path);
+	}
+	return ok;
+}
+
+bool readPatchOrders(const char *path, PatchId ***pusPatchOrders, int *numOrders, int *numPatches, int **piIndexBufferIn, int **piClustersIn, int *numFaces)
+{
+	FILE * myFile = fopen(path, "rb");
+	if (myFile == NULL)
+	{
+		jobPrintf("ERROR: File cannot be opened %s\n", path);
+		return false;
+	}
+	PatchOrderHeader header;
+	if (fread(&header, sizeof(header), 1, myFile) != 1 || header.magic != PATCHORDERMAGIC || header.version != PATCHORDERVERSION
+		|| header.numPatches <= 0 || header.numPatches > MAXPATCHES || header.numOrders < 0 || header.numFaces < header.numPatches)
+	{
+		jobPrintf("ERROR: %s is not an orderings file\n", path);
+		fclose(myFile);
+		return false;
+	}
+	int *piClusters = (int *)malloc((header.numPatches + 1) * sizeof(int));
+	int *piIndexBuffer = (int *)malloc(header.numFaces * 3 * sizeof(int));
+	// row pointers followed by the permutations, freed with one free
+	PatchId **pusOrders = (PatchId **)malloc(header.numOrders * (sizeof(PatchId *) + header.numPatches * sizeof(PatchId)) + sizeof(PatchId *));
+	PatchId *pusData = (PatchId *)(pusOrders + header.numOrders);
+	for (int i = 0; i < header.numOrders; i++)
+		pusOrders[i] = pusData + i * header.numPatches;
+
+	bool ok = fread(piClusters, sizeof(int), header.numPatches + 1, myFile) == (size_t)(header.numPatches + 1)
+		&& fread(piIndexBuffer, sizeof(int), header.numFaces * 3, myFile) == (size_t)(header.numFaces * 3)
+		&& fread(pusData, sizeof(PatchId), header.numOrders * header.numPatches, myFile) == (size_t)(header.numOrders * header.numPatches);
+	fclose(myFile);
+	// expandPatchOrder copies the faces of every patch once: the offsets must not decrease and every order must be
+	// a permutation, or it would copy a negative count or past the end of the index buffer
+	if (ok && (piClusters[0] != 0 || piClusters[header.numPatches] != header.numFaces))
+		ok = false;
+	for (int i = 0; ok && i < header.numPatches; i++)
+	{
+		if (piClusters[i] > piClusters[i + 1])
+			ok = false;
+	}
+	char *pbSeen = (char *)malloc(header.numPatches);
+	for (int i = 0; ok && i < header.numOrders; i++)
+	{
+		memset(pbSeen, 0, header.numPatches);
+		for (int j = 0; ok && j < header.numPatches; j++)
+		{
+			PatchId patchId = pusOrders[i][j];
+			if (patchId >= header.numPatches || pbSeen[patchId])
+				ok = false;
+			else
+				pbSeen[patchId] = 1;
+		}
+	}
+	free(pbSeen);
+	if (!ok)
+	{
+		jobPrintf("ERROR: %s is truncated or corrupt\n", path);
+		freePatchOrders(pusOrders, piIndexBuffer, piClusters);
+		return false;
+	}
+	*pusPatchOrders = pusOrders;
+	*numOrders = header.numOrders;
+	*numPatches = header.numPatches;
+	*piIndexBufferIn = piIndexBuffer;
+	*piClustersIn = piClusters;
+	*numFaces = header.numFaces;
+	return true;
+}
+
+void freePatchOrders(PatchId **pusPatchOrders, int *piIndexBufferIn, int *piClustersIn)
+{
+	free(pusPatchOrders);
+	free(piIndexBufferIn);
+	free(piClustersIn);
+}
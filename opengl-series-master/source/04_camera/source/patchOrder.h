@@ -0,0 +1,20 @@
+#pragma once
+
+// a cluster ordering (mean) is a permutation of the patches produced by FanVertCluster: entry i is the
+// patch drawn i-th. All orderings of a character share one clustered index buffer and its patch offsets,
+// so an ordering costs numPatches*2 bytes instead of a full numFaces*3 int index buffer.
+#define PATCHORDERMAGIC 0x4F504656 // "VFPO"
+#define PATCHORDERVERSION 1
+#define MAXPATCHES 65535
+
+typedef unsigned short PatchId;
+
+// writes the index data of pusPatchOrder into piIndexBufferOut (numFaces*3 ints)
+void expandPatchOrder(const PatchId *pusPatchOrder, int numPatches, const int *piIndexBufferIn, const int *piClustersIn, int *piIndexBufferOut);
+
+// orderings file: header | piClustersIn (numPatches+1 ints) | clustered index buffer (numFaces*3 ints) | numOrders permutations
+bool writePatchOrders(const char *path, PatchId **pusPatchOrders, int numOrders, int numPatches, const int *piIndexBufferIn, const int *piClustersIn, int numFaces);
+
+// reads a file written by writePatchOrders; the arrays are malloc'd and freed with freePatchOrders
+bool readPatchOrders(const char *path, PatchId ***pusPatchOrders, int *numOrders, int *numPatches, int **piIndexBufferIn, int **piClustersIn, int *numFaces);
+void freePatchOrders(PatchId **pusPatchOrders, int *piIndexBufferIn, int *piClustersIn);
@@ -0,0 +1,311 @@
+#include "rayEstimator.h"
+#include "jobLog.h"
+#include "softRaster.h"
+#include "threadPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+struct RayHit
+{
+	int patchId;
+	int ray;
+	int face;
+	float t;
+};
+
+static bool rayHitLess(const RayHit &a, const RayHit &b)
+{
+	if (a.patchId != b.patchId)
+		return a.patchId < b.patchId;
+	if (a.ray != b.ray)
+		return a.ray < b.ray;
+	return a.face < b.face;
+}
+
+static void buildRayBVHNode(RayBVH *bvh, int nodeId, int first, int numFaces, const std::vector<float> &centroids)
+{
+	const float *p = bvh->pfVertexPositions;
+	const int *ib = bvh->piIndexBuffer;
+	RayBVHNode node;
+	float cmin[3], cmax[3];
+	for (int k = 0; k < 3; k++)
+	{
+		node.bmin[k] = cmin[k] = 1e30f;
+		node.bmax[k] = cmax[k] = -1e30f;
+	}
+	for (int i = first; i < first + numFaces; i++)
+	{
+		int f = bvh->faces[i];
+		for (int m = 0; m < 3; m++)
+		{
+			const float *v = p + ib[f * 3 + m] * 3;
+			for (int k = 0; k < 3; k++)
+			{
+				node.bmin[k] = std::min(node.bmin[k], v[k]);
+				node.bmax[k] = std::max(node.bmax[k], v[k]);
+			}
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			cmin[k] = std::min(cmin[k], centroids[f * 3 + k]);
+			cmax[k] = std::max(cmax[k], centroids[f * 3 + k]);
+		}
+	}
+	if (numFaces <= RAYBVHLEAF)
+	{
+		node.first = first;
+		node.numFaces = numFaces;
+		bvh->nodes[nodeId] = node;
+		return;
+	}
+	int axis = 0;
+	for (int k = 1; k < 3; k++)
+	{
+		if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis])
+			axis = k;
+	}
+	int half = numFaces / 2;
+	std::nth_element(bvh->faces.begin() + first, bvh->faces.begin() + first + half, bvh->faces.begin() + first + numFaces,
+		[&](int a, int b) { return centroids[a * 3 + axis] < centroids[b * 3 + axis]; });
+	node.first = (int)bvh->nodes.size();
+	node.numFaces = 0;
+	bvh->nodes[nodeId] = node;
+	bvh->nodes.resize(bvh->nodes.size() + 2);
+	buildRayBVHNode(bvh, node.first, first, half, centroids);
+	buildRayBVHNode(bvh, node.first + 1, first + half, numFaces - half, centroids);
+}
+
+void buildRayBVH(const float *pfVertexPositions, const int *piIndexBuffer, int iNumFaces, RayBVH *bvh)
+{
+	bvh->pfVertexPositions = pfVertexPositions;
+	bvh->piIndexBuffer = piIndexBuffer;
+	bvh->faces.resize(iNumFaces);
+	std::vector<float> centroids(iNumFaces * 3);
+	for (int f = 0; f < iNumFaces; f++)
+	{
+		bvh->faces[f] = f;
+		for (int k = 0; k < 3; k++)
+			centroids[f * 3 + k] = (pfVertexPositions[piIndexBuffer[f * 3] * 3 + k] + pfVertexPositions[piIndexBuffer[f * 3 + 1] * 3 + k]
+				+ pfVertexPositions[piIndexBuffer[f * 3 + 2] * 3 + k]) / 3.f;
+	}
+	bvh->nodes.clear();
+	bvh->nodes.resize(1);
+	if (iNumFaces > 0)
+		buildRayBVHNode(bvh, 0, 0, iNumFaces, centroids);
+	else
+		memset(&bvh->nodes[0], 0, sizeof(RayBVHNode));
+}
+
+// segment [0, 1) against a node box
+static bool rayHitsBox(const RayBVHNode &node, const float *o, const float *invD)
+{
+	float t0 = 0.f, t1 = 1.f;
+	for (int k = 0; k < 3; k++)
+	{
+		float a = (node.bmin[k] - o[k]) * invD[k], b = (node.bmax[k] - o[k]) * invD[k];
+		if (a > b)
+			std::swap(a, b);
+		t0 = std::max(t0, a);
+		t1 = std::min(t1, b);
+		if (t0 > t1)
+			return false;
+	}
+	return true;
+}
+
+// Moller-Trumbore, back faces (clockwise seen from the camera) culled as in softRaster
+static bool rayHitsFace(const float *v0, const float *v1, const float *v2, const float *o, const float *d, float &t)
+{
+	float e1[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+	float e2[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+	float pv[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+	float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+	if (!(det > 0.f))
+		return false;
+	float s[3] = { o[0] - v0[0], o[1] - v0[1], o[2] - v0[2] };
+	float u = s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2];
+	if (u < 0.f || u > det)
+		return false;
+	float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	float v = d[0] * q[0] + d[1] * q[1] + d[2] * q[2];
+	if (v < 0.f || u + v > det)
+		return false;
+	t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+	return t >= 0.f && t < 1.f;
+}
+
+void traceViewRays(const RayBVH *bvh, const int *piClustersIn, int numPatches, const float *pfViewMatrix, int numRays,
+	unsigned int seed, PatchCoverage *samples)
+{
+	glm::mat4 inverse = glm::inverse(glm::make_mat4(pfViewMatrix));
+	const float *p = bvh->pfVertexPositions;
+	const int *ib = bvh->piIndexBuffer;
+	std::vector<RayHit> hits;
+	std::vector<int> stack;
+	unsigned int state = seed * 2654435761u + 1u;
+	for (int ray = 0; ray < numRays; ray++)
+	{
+		// xorshift32, uniform in the view
+		float ndc[2];
+		for (int k = 0; k < 2; k++)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			ndc[k] = (state >> 8) * (2.f / 16777216.f) - 1.f;
+		}
+		glm::vec4 nearPoint = inverse * glm::vec4(ndc[0], ndc[1], -1.f, 1.f);
+		glm::vec4 farPoint = inverse * glm::vec4(ndc[0], ndc[1], 1.f, 1.f);
+		float o[3], d[3], invD[3];
+		for (int k = 0; k < 3; k++)
+		{
+			o[k] = nearPoint[k] / nearPoint.w;
+			d[k] = farPoint[k] / farPoint.w - o[k];
+			invD[k] = 1.f / d[k];
+		}
+
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const RayBVHNode &node = bvh->nodes[stack.back()];
+			stack.pop_back();
+			if (!rayHitsBox(node, o, invD))
+				continue;
+			if (node.numFaces == 0)
+			{
+				stack.push_back(node.first);
+				stack.push_back(node.first + 1);
+				continue;
+			}
+			for (int i = node.first; i < node.first + node.numFaces; i++)
+			{
+				int f = bvh->faces[i];
+				float t;
+				if (rayHitsFace(p + ib[f * 3] * 3, p + ib[f * 3 + 1] * 3, p + ib[f * 3 + 2] * 3, o, d, t))
+				{
+					RayHit hit = { (int)(std::upper_bound(piClustersIn, piClustersIn + numPatches + 1, f) - piClustersIn) - 1, ray, f, t };
+					hits.push_back(hit);
+				}
+			}
+		}
+	}
+
+	std::sort(hits.begin(), hits.end(), rayHitLess);
+	samples->numPatches = numPatches;
+	samples->numPixels = numRays;
+	samples->patchRuns.assign(numPatches + 1, 0);
+	samples->patchDepths.assign(numPatches + 1, 0);
+	samples->runs.clear();
+	samples->depths.clear();
+	std::vector<char> shown(numRays, 0);
+	std::vector<CoverageFragment> fragments;
+	size_t h = 0;
+	for (int patchId = 0; patchId < numPatches; patchId++)
+	{
+		fragments.clear();
+		for (; h < hits.size() && hits[h].patchId == patchId; h++)
+		{
+			CoverageFragment fragment = { hits[h].ray, hits[h].t };
+			fragments.push_back(fragment);
+		}
+		appendPatchRuns(samples, patchId, fragments.empty() ? NULL : &fragments[0], (int)fragments.size(), shown.empty() ? NULL : &shown[0]);
+	}
+	samples->runs.shrink_to_fit();
+	samples->depths.shrink_to_fit();
+	samples->shownPixels = 0;
+	for (int i = 0; i < numRays; i++)
+		samples->shownPixels += shown[i];
+}
+
+void estimateOverdraw(const PatchCoverage *samples, const PatchId *pusPatchOrder, RayEstimate *estimate, float *pfDepth, int *piDrawn)
+{
+	int n = samples->numPixels;
+	std::vector<float> depth;
+	std::vector<int> drawn;
+	if (pfDepth == NULL || piDrawn == NULL)
+	{
+		depth.resize(n + 1);
+		drawn.resize(n + 1);
+		pfDepth = &depth[0];
+		piDrawn = &drawn[0];
+	}
+	int sumDrawn = patchOrderDrawnPixels(samples, pusPatchOrder, pfDepth, piDrawn);
+	estimate->numRays = n;
+	estimate->shownRays = samples->shownPixels;
+	estimate->ratio = 0.f;
+	estimate->halfWidth = 0.f;
+	if (samples->shownPixels == 0)
+		return;
+	// ratio estimator R = sum(drawn) / sum(shown), var(R) ~ var(drawn - R shown) / (n mean(shown)^2)
+	double r = (double)sumDrawn / samples->shownPixels;
+	double meanShown = (double)samples->shownPixels / n;
+	double sum2 = 0.0;
+	for (int i = 0; i < n; i++)
+	{
+		double e = piDrawn[i] - r * (piDrawn[i] > 0 ? 1.0 : 0.0);  // a ray is shown iff something passed
+		sum2 += e * e;
+	}
+	double variance = n > 1 ? sum2 / (n - 1) / (n * meanShown * meanShown) : 0.0;
+	estimate->ratio = (float)r;
+	estimate->halfWidth = (float)(1.96 * sqrt(variance));
+}
+
+void buildRayCache(float **pfFramesVertexPositions, int numFrames, const int *piIndexBufferIn, const int *piClustersIn, int numPatches,
+	int iNumFaces, const float *pfCameraPositions, int numViews, float fAspect, int numRays, CoverageCache *cache, ThreadPool *pool)
+{
+	cache->numFrames = numFrames;
+	cache->numViews = numViews;
+	cache->numPixels = numRays;
+	cache->coverage.clear();
+	cache->coverage.resize(numFrames * numViews);
+	if (numViews <= 0)
+		return;
+	std::vector<float> viewMatrices(numViews * 16);
+	buildViewMatrices(pfCameraPositions, numViews, fAspect, &viewMatrices[0]);
+	std::vector<RayBVH> bvhs(numFrames);
+	parallelFor(pool, 0, numFrames, [&](int frameId) {
+		buildRayBVH(pfFramesVertexPositions[frameId], piIndexBufferIn, iNumFaces, &bvhs[frameId]);
+	});
+	parallelFor(pool, 0, numFrames * numViews, [&](int i) {
+		int frameId = i / numViews, viewId = i % numViews;
+		traceViewRays(&bvhs[frameId], piClustersIn, numPatches, &viewMatrices[viewId * 16], numRays, (unsigned int)i + 1u, &cache->coverage[i]);
+	});
+}
+
+void printRayEstimateReport(const char *const *names, PatchId *const *pusPatchOrders, int numOrders, const CoverageCache *rays,
+	const CoverageCache *exact)
+{
+	std::vector<float> depth(std::max(rays->numPixels, exact->numPixels) + 1);
+	std::vector<int> drawn(rays->numPixels + 1);
+	jobPrintf("%-14s %9s %9s %9s %9s %8s   (%d rays per view)\n", "ordering", "estimate", "+-95%", "exact", "abs err", "inside", rays->numPixels);
+	for (int o = 0; o < numOrders; o++)
+	{
+		double sumEstimate = 0.0, sumHalfWidth = 0.0, sumExact = 0.0, sumError = 0.0;
+		int count = 0, inside = 0;
+		for (size_t i = 0; i < rays->coverage.size() && i < exact->coverage.size(); i++)
+		{
+			if (exact->coverage[i].shownPixels == 0)
+				continue;
+			RayEstimate estimate;
+			estimateOverdraw(&rays->coverage[i], pusPatchOrders[o], &estimate, &depth[0], &drawn[0]);
+			float ratio = patchOrderRatio(&exact->coverage[i], pusPatchOrders[o], &depth[0]);
+			sumEstimate += estimate.ratio;
+			sumHalfWidth += estimate.halfWidth;
+			sumExact += ratio;
+			sumError += fabs(estimate.ratio - ratio);
+			inside += fabs(estimate.ratio - ratio) <= estimate.halfWidth;
+			count++;
+		}
+		if (count == 0)
+			continue;
+		jobPrintf("%-14s %9.4f %9.4f %9.4f %9.4f %7.1f%%\n", names[o], sumEstimate / count, sumHalfWidth / count, sumExact / count,
+			sumError / count, 100.0 * inside / count);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "patchCoverage.h"
+
+class ThreadPool;
+
+// Sampled estimate of the overdraw: instead of rasterizing every pixel, numRays rays per view are cast through a
+// BVH of the frame's triangles, from the near to the far plane of the softRaster camera, at uniform random points
+// of the view. Every hit that faces the camera is recorded and the hits are kept in the PatchCoverage layout with a
+// ray in place of a pixel (the depth is the ray parameter in [0, 1)), so an ordering is scored with
+// patchOrderDrawnPixels. The ratio drawn/shown over the rays is a ratio estimator of the overdraw of the view; its
+// 95% interval comes from the delta method.
+
+struct RayBVHNode
+{
+	float bmin[3];
+	float bmax[3];
+	int first;      // leaf: first face in RayBVH::faces, inner: index of the left child (the right one follows it)
+	int numFaces;   // 0 for inner nodes
+};
+
+struct RayBVH
+{
+	const float *pfVertexPositions;
+	const int *piIndexBuffer;
+	std::vector<RayBVHNode> nodes;
+	std::vector<int> faces;
+};
+
+struct RayEstimate
+{
+	float ratio;
+	float halfWidth;   // of the 95% confidence interval
+	int numRays;
+	int shownRays;
+};
+
+// median split on the longest centroid axis, at most RAYBVHLEAF faces per leaf
+#define RAYBVHLEAF 4
+void buildRayBVH(const float *pfVertexPositions, const int *piIndexBuffer, int iNumFaces, RayBVH *bvh);
+
+// hits of numRays rays through one view (matrix from buildViewMatrices), grouped by the patches of piClustersIn
+void traceViewRays(const RayBVH *bvh, const int *piClustersIn, int numPatches, const float *pfViewMatrix, int numRays,
+	unsigned int seed, PatchCoverage *samples);
+
+// estimate for one ordering; pfDepth and piDrawn hold numRays entries and may be NULL
+void estimateOverdraw(const PatchCoverage *samples, const PatchId *pusPatchOrder, RayEstimate *estimate, float *pfDepth = NULL, int *piDrawn = NULL);
+
+// ray samples of every (frame, view), frame major, in the CoverageCache of the exact coverage so that everything
+// built on it (occlusion graphs, ordering scores) runs on samples as well; one BVH per frame
+void buildRayCache(float **pfFramesVertexPositions, int numFrames, const int *piIndexBufferIn, const int *piClustersIn, int numPatches,
+	int iNumFaces, const float *pfCameraPositions, int numViews, float fAspect, int numRays, CoverageCache *cache, ThreadPool *pool);
+
+// prints for each ordering the mean estimate and interval over the frames and views, the mean error against the
+// exact coverage and how often the exact overdraw falls inside the interval
+void printRayEstimateReport(const char *const *names, PatchId *const *pusPatchOrders, int numOrders, const CoverageCache *rays,
+	const CoverageCache *exact);
@@ -0,0 +1,246 @@
+#include "skinning.h"
+#include "jobLog.h"
+#include "textLoader.h"
+#include "threadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKINNING_SSE
+#endif
+
+// c = a * b for 3x4 row major affine matrices
+static void mulAffine(const float *a, const float *b, float *c)
+{
+	for (int r = 0; r < 3; r++)
+	{
+		const float *ar = a + r * 4;
+		for (int col = 0; col < 4; col++)
+		{
+			c[r * 4 + col] = ar[0] * b[col] + ar[1] * b[4 + col] + ar[2] * b[8 + col];
+		}
+		c[r * 4 + 3] += ar[3];
+	}
+}
+
+bool hasSkinnedMesh(const char *vfFolder)
+{
+	char path[300];
+	strcpy(path, vfFolder);
+	strcat(path, "skeleton.txt");
+	FILE * myFile = fopen(path, "r");
+	if (myFile == NULL)
+		return false;
+	fclose(myFile);
+	return true;
+}
+
+bool loadSkinnedMesh(const char *vfFolder, int iNumVertices, int numFrames, SkinnedMesh *mesh, ThreadPool *pool)
+{
+	memset(mesh, 0, sizeof(SkinnedMesh));
+	char path[300];
+	strcpy(path, vfFolder);
+	strcat(path, "skeleton.txt");
+	int numSkeletonValues = countTextValues(path);
+	if (numSkeletonValues <= 0 || numSkeletonValues % 13 != 0)
+	{
+		jobPrintf("ERROR: %s should have 13 values per joint\n", path);
+		return false;
+	}
+	int numJoints = numSkeletonValues / 13;
+	mesh->iNumVertices = iNumVertices;
+	mesh->numJoints = numJoints;
+	mesh->numFrames = numFrames;
+	mesh->pfBindPositions = (float *)malloc(iNumVertices * 3 * sizeof(float));
+	mesh->piJoints = (int *)malloc(iNumVertices * SKINNUMINFLUENCES * sizeof(int));
+	mesh->pfWeights = (float *)malloc(iNumVertices * SKINNUMINFLUENCES * sizeof(float));
+	mesh->piParents = (int *)malloc(numJoints * sizeof(int));
+	mesh->pfInverseBind = (float *)malloc(numJoints * 12 * sizeof(float));
+	mesh->pfFramesLocal = (float *)malloc(numFrames * numJoints * 12 * sizeof(float));
+	mesh->pfJointMoments = (float *)malloc(numJoints * 4 * sizeof(float));
+
+	std::vector<float> skeleton(numSkeletonValues);
+	bool ok = loadTextFloats(path, &skeleton[0], numSkeletonValues, pool);
+	strcpy(path, vfFolder);
+	strcat(path, "bindpose.txt");
+	ok = ok && loadTextFloats(path, mesh->pfBindPositions, iNumVertices * 3, pool);
+	strcpy(path, vfFolder);
+	strcat(path, "skinjoints.txt");
+	ok = ok && loadTextInts(path, mesh->piJoints, iNumVertices * SKINNUMINFLUENCES, pool);
+	strcpy(path, vfFolder);
+	strcat(path, "skinweights.txt");
+	ok = ok && loadTextFloats(path, mesh->pfWeights, iNumVertices * SKINNUMINFLUENCES, pool);
+
+	std::vector<char> frameOk(numFrames, 0);
+	parallelFor(pool, 0, numFrames, [&](int i) {
+		char framePath[300];
+		sprintf(framePath, "%sjoints%d.txt", vfFolder, i + 1);
+		frameOk[i] = loadTextFloats(framePath, mesh->pfFramesLocal + i * numJoints * 12, numJoints * 12, NULL);
+	});
+	for (int i = 0; i < numFrames; i++)
+		ok = ok && frameOk[i];
+
+	for (int j = 0; ok && j < numJoints; j++)
+	{
+		mesh->piParents[j] = (int)skeleton[j * 13];
+		memcpy(mesh->pfInverseBind + j * 12, &skeleton[j * 13 + 1], 12 * sizeof(float));
+		if (mesh->piParents[j] >= j)
+		{
+			jobPrintf("ERROR: joint %d has parent %d, parents must come first\n", j, mesh->piParents[j]);
+			ok = false;
+		}
+	}
+
+	// normalize the weights so the blended matrices stay affine, and gather the per joint moments
+	// that let skinFrame compute the centroid of a frame before skinning it
+	std::vector<double> moments(numJoints * 4, 0.0);
+	for (int v = 0; ok && v < iNumVertices; v++)
+	{
+		int *piJoints = mesh->piJoints + v * SKINNUMINFLUENCES;
+		float *pfWeights = mesh->pfWeights + v * SKINNUMINFLUENCES;
+		float sum = 0.f;
+		for (int k = 0; k < SKINNUMINFLUENCES; k++)
+		{
+			if (piJoints[k] < 0 || piJoints[k] >= numJoints)
+			{
+				jobPrintf("ERROR: vertex %d uses joint %d of %d\n", v, piJoints[k], numJoints);
+				ok = false;
+				break;
+			}
+			sum += pfWeights[k];
+		}
+		if (sum <= 0.f)
+		{
+			pfWeights[0] = 1.f;
+			sum = 1.f;
+		}
+		for (int k = 0; ok && k < SKINNUMINFLUENCES; k++)
+		{
+			pfWeights[k] /= sum;
+			double *pMoment = &moments[piJoints[k] * 4];
+			pMoment[0] += pfWeights[k] * mesh->pfBindPositions[v * 3];
+			pMoment[1] += pfWeights[k] * mesh->pfBindPositions[v * 3 + 1];
+			pMoment[2] += pfWeights[k] * mesh->pfBindPositions[v * 3 + 2];
+			pMoment[3] += pfWeights[k];
+		}
+	}
+	for (int i = 0; i < numJoints * 4; i++)
+		mesh->pfJointMoments[i] = (float)moments[i];
+	if (!ok)
+		freeSkinnedMesh(mesh);
+	return ok;
+}
+
+void freeSkinnedMesh(SkinnedMesh *mesh)
+{
+	free(mesh->pfBindPositions);
+	free(mesh->piJoints);
+	free(mesh->pfWeights);
+	free(mesh->piParents);
+	free(mesh->pfInverseBind);
+	free(mesh->pfFramesLocal);
+	free(mesh->pfJointMoments);
+	memset(mesh, 0, sizeof(SkinnedMesh));
+}
+
+int SkinScratchSize(const SkinnedMesh *mesh)
+{
+	return mesh->numJoints * (12 + 12 + 16);
+}
+
+void skinFrame(const SkinnedMesh *mesh, int frameId, float *pfVertexPositionsOut, float *pfScratch)
+{
+	int numJoints = mesh->numJoints;
+	int iNumVertices = mesh->iNumVertices;
+	float *pfGlobal = pfScratch;
+	float *pfSkin = pfGlobal + numJoints * 12;
+	float *pfColumns = pfSkin + numJoints * 12;  // 4 columns of 4 floats per joint
+	const float *pfLocal = mesh->pfFramesLocal + frameId * numJoints * 12;
+
+	// skinning matrices and the centroid of the skinned frame: since the weights of a vertex sum to 1,
+	// the centroid is sum over joints of skin(j) * moment(j) / iNumVertices
+	double center[3] = { 0.0, 0.0, 0.0 };
+	for (int j = 0; j < numJoints; j++)
+	{
+		float *g = pfGlobal + j * 12;
+		if (mesh->piParents[j] < 0)
+			memcpy(g, pfLocal + j * 12, 12 * sizeof(float));
+		else
+			mulAffine(pfGlobal + mesh->piParents[j] * 12, pfLocal + j * 12, g);
+		float *s = pfSkin + j * 12;
+		mulAffine(g, mesh->pfInverseBind + j * 12, s);
+		const float *m = mesh->pfJointMoments + j * 4;
+		for (int r = 0; r < 3; r++)
+			center[r] += s[r * 4] * m[0] + s[r * 4 + 1] * m[1] + s[r * 4 + 2] * m[2] + s[r * 4 + 3] * m[3];
+	}
+	for (int r = 0; r < 3; r++)
+		center[r] /= iNumVertices;
+
+	// column major copies with the centering folded into the translation
+	for (int j = 0; j < numJoints; j++)
+	{
+		const float *s = pfSkin + j * 12;
+		float *c = pfColumns + j * 16;
+		for (int col = 0; col < 4; col++)
+		{
+			c[col * 4] = s[col];
+			c[col * 4 + 1] = s[4 + col];
+			c[col * 4 + 2] = s[8 + col];
+			c[col * 4 + 3] = 0.f;
+		}
+		c[12] -= (float)center[0];
+		c[13] -= (float)center[1];
+		c[14] -= (float)center[2];
+	}
+
+	const float *p = mesh->pfBindPositions;
+	const int *piJoints = mesh->piJoints;
+	const float *pfWeights = mesh->pfWeights;
+	float *out = pfVertexPositionsOut;
+	int v = 0;
+#ifdef SKINNING_SSE
+	// the 4 wide store also writes the x of the next vertex, so the last vertex is left to the scalar loop
+	for (; v < iNumVertices - 1; v++, p += 3, piJoints += SKINNUMINFLUENCES, pfWeights += SKINNUMINFLUENCES, out += 3)
+	{
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (int k = 0; k < SKINNUMINFLUENCES; k++)
+		{
+			const float *c = pfColumns + piJoints[k] * 16;
+			__m128 w = _mm_set1_ps(pfWeights[k]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(c)));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(c + 4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(c + 8)));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(c + 12)));
+		}
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1]))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p[2])), c3));
+		_mm_storeu_ps(out, r);
+	}
+#endif
+	for (; v < iNumVertices; v++, p += 3, piJoints += SKINNUMINFLUENCES, pfWeights += SKINNUMINFLUENCES, out += 3)
+	{
+		float r[3] = { 0.f, 0.f, 0.f };
+		for (int k = 0; k < SKINNUMINFLUENCES; k++)
+		{
+			const float *c = pfColumns + piJoints[k] * 16;
+			float w = pfWeights[k];
+			for (int i = 0; i < 3; i++)
+				r[i] += w * (c[i] * p[0] + c[4 + i] * p[1] + c[8 + i] * p[2] + c[12 + i]);
+		}
+		out[0] = r[0];
+		out[1] = r[1];
+		out[2] = r[2];
+	}
+}
+
+void skinFrames(const SkinnedMesh *mesh, int firstFrame, int numFrames, float **pfFramesVertexPositions, ThreadPool *pool)
+{
+	parallelFor(pool, 0, numFrames, [&](int i) {
+		std::vector<float> scratch(SkinScratchSize(mesh));
+		skinFrame(mesh, firstFrame + i, pfFramesVertexPositions[i], &scratch[0]);
+	});
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+class ThreadPool;
+
+// skinned version of an animation folder, replaces the baked frame<N>v.txt files:
+//   bindpose.txt     iNumVertices*3 floats, bind pose positions
+//   skinjoints.txt   iNumVertices*4 ints, joint of each influence (unused influences have weight 0)
+//   skinweights.txt  iNumVertices*4 floats, weight of each influence (normalized on load)
+//   skeleton.txt     13 floats per joint: parent index (-1 for a root, parents before children)
+//                    followed by the 3x4 row major inverse bind matrix
+//   joints<N>.txt    12 floats per joint for frame N: 3x4 row major transform relative to the parent
+#define SKINNUMINFLUENCES 4
+
+struct SkinnedMesh
+{
+	int iNumVertices;
+	int numJoints;
+	int numFrames;
+	float *pfBindPositions;  // iNumVertices*3
+	int *piJoints;           // iNumVertices*SKINNUMINFLUENCES
+	float *pfWeights;        // iNumVertices*SKINNUMINFLUENCES
+	int *piParents;          // numJoints
+	float *pfInverseBind;    // numJoints*12
+	float *pfFramesLocal;    // numFrames*numJoints*12
+	float *pfJointMoments;   // numJoints*4: sum of weight*bind position and sum of weight, used for centering
+};
+
+// true if vfFolder contains skinning data instead of baked frames
+bool hasSkinnedMesh(const char *vfFolder);
+
+bool loadSkinnedMesh(const char *vfFolder, int iNumVertices, int numFrames, SkinnedMesh *mesh, ThreadPool *pool);
+void freeSkinnedMesh(SkinnedMesh *mesh);
+
+// linear blend skinning of one frame into pfVertexPositionsOut (3 floats per vertex), translated so that
+// the vertex centroid is at the origin; pfScratch needs SkinScratchSize floats
+int SkinScratchSize(const SkinnedMesh *mesh);
+void skinFrame(const SkinnedMesh *mesh, int frameId, float *pfVertexPositionsOut, float *pfScratch);
+
+// skins frames [firstFrame, firstFrame+numFrames) into pfFramesVertexPositions, one frame per task
+void skinFrames(const SkinnedMesh *mesh, int firstFrame, int numFrames, float **pfFramesVertexPositions, ThreadPool *pool);
@@ -0,0 +1,226 @@
+#include "softRaster.h"
+#include "jobLog.h"
+#include "threadPool.h"
+#include "tdogl/Camera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void buildViewMatrices(const float *pfCameraPositions, int numViews, float fAspect, float *pfViewMatrices)
+{
+	tdogl::Camera camera;
+	camera.setViewportAspectRatio(fAspect);
+	camera.setFieldOfView(40.0f);
+	camera.setNearAndFarPlanes(1.0f, 2000.0f);
+	for (int cameraId = 0; cameraId < numViews; cameraId++)
+	{
+		camera.setPosition(glm::vec3(pfCameraPositions[cameraId * 3], pfCameraPositions[cameraId * 3 + 1], pfCameraPositions[cameraId * 3 + 2]));
+		camera.lookAt(glm::vec3(0.0f, 0.0f, 0.0f));
+		glm::mat4 m = camera.matrix();
+		for (int col = 0; col < 4; col++)
+			for (int row = 0; row < 4; row++)
+				pfViewMatrices[cameraId * 16 + col * 4 + row] = m[col][row];
+	}
+}
+
+struct ClipVertex
+{
+	float v[4];
+};
+
+// window coordinates of a clip space vertex that is in front of the near plane
+static void toWindow(const ClipVertex &p, int iWidth, int iHeight, float &x, float &y, float &z)
+{
+	float invW = 1.f / p.v[3];
+	x = (p.v[0] * invW + 1.f) * 0.5f * iWidth;
+	y = (p.v[1] * invW + 1.f) * 0.5f * iHeight;
+	z = p.v[2] * invW;
+}
+
+static void emitTriangle(const ClipVertex &p0, const ClipVertex &p1, const ClipVertex &p2, int face, int iWidth, int iHeight,
+	std::vector<RasterTriangle> &triangles)
+{
+	RasterTriangle t;
+	toWindow(p0, iWidth, iHeight, t.x[0], t.y[0], t.z[0]);
+	toWindow(p1, iWidth, iHeight, t.x[1], t.y[1], t.z[1]);
+	toWindow(p2, iWidth, iHeight, t.x[2], t.y[2], t.z[2]);
+	// back faces and degenerate triangles (GL_CULL_FACE, GL_BACK, GL_CCW)
+	float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (!(area > 0.f))
+		return;
+	float minX = std::min(t.x[0], std::min(t.x[1], t.x[2])), maxX = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+	float minY = std::min(t.y[0], std::min(t.y[1], t.y[2])), maxY = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+	// pixels whose center can be inside
+	t.bbox[0] = minX < 0.5f ? 0 : (int)ceilf(minX - 0.5f);
+	t.bbox[1] = minY < 0.5f ? 0 : (int)ceilf(minY - 0.5f);
+	t.bbox[2] = maxX + 0.5f >= iWidth ? iWidth : (int)floorf(maxX + 0.5f) + 1;
+	t.bbox[3] = maxY + 0.5f >= iHeight ? iHeight : (int)floorf(maxY + 0.5f) + 1;
+	if (t.bbox[0] >= t.bbox[2] || t.bbox[1] >= t.bbox[3])
+		return;
+	t.face = face;
+	triangles.push_back(t);
+}
+
+void setupViewTriangles(const float *pfVertexPositions, int iNumVertices, const int *piIndexBuffer, int iNumFaces,
+	const float *pfViewMatrix, int iWidth, int iHeight, std::vector<RasterTriangle> &triangles)
+{
+	triangles.clear();
+	const float *m = pfViewMatrix;
+	std::vector<ClipVertex> clip(iNumVertices);
+	for (int i = 0; i < iNumVertices; i++)
+	{
+		const float *p = pfVertexPositions + i * 3;
+		for (int row = 0; row < 4; row++)
+			clip[i].v[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+	}
+
+	for (int f = 0; f < iNumFaces; f++)
+	{
+		const ClipVertex *p[3] = { &clip[piIndexBuffer[f * 3]], &clip[piIndexBuffer[f * 3 + 1]], &clip[piIndexBuffer[f * 3 + 2]] };
+		// trivial rejection against the side and far planes
+		bool outside = false;
+		for (int axis = 0; axis < 3 && !outside; axis++)
+		{
+			outside = (p[0]->v[axis] > p[0]->v[3] && p[1]->v[axis] > p[1]->v[3] && p[2]->v[axis] > p[2]->v[3])
+				|| (axis < 2 && p[0]->v[axis] < -p[0]->v[3] && p[1]->v[axis] < -p[1]->v[3] && p[2]->v[axis] < -p[2]->v[3]);
+		}
+		if (outside)
+			continue;
+		float d[3];
+		int numIn = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			d[i] = p[i]->v[2] + p[i]->v[3];  // distance to the near plane z = -w
+			if (d[i] >= 0.f)
+				numIn++;
+		}
+		if (numIn == 3)
+		{
+			emitTriangle(*p[0], *p[1], *p[2], f, iWidth, iHeight, triangles);
+			continue;
+		}
+		if (numIn == 0)
+			continue;
+		// near plane clipping, the polygon has 3 or 4 vertices and is drawn as a fan
+		ClipVertex poly[4];
+		int n = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			int j = (i + 1) % 3;
+			if (d[i] >= 0.f)
+				poly[n++] = *p[i];
+			if ((d[i] >= 0.f) != (d[j] >= 0.f))
+			{
+				float s = d[i] / (d[i] - d[j]);
+				for (int k = 0; k < 4; k++)
+					poly[n].v[k] = p[i]->v[k] + s * (p[j]->v[k] - p[i]->v[k]);
+				n++;
+			}
+		}
+		for (int i = 1; i + 1 < n; i++)
+			emitTriangle(poly[0], poly[i], poly[i + 1], f, iWidth, iHeight, triangles);
+	}
+}
+
+// depth test and fragment count of one tile
+struct OverdrawTile
+{
+	int x0, y0, iWidth;
+	float *pfDepth;
+	int *piCount;
+	void operator()(int x, int y, float z)
+	{
+		int i = (y - y0) * iWidth + (x - x0);
+		if (z < pfDepth[i])
+		{
+			pfDepth[i] = z;
+			piCount[i]++;
+		}
+	}
+};
+
+void softwareOverdraw(const float *pfVertexPositions, int iNumVertices, const int *piIndexBuffer, int iNumFaces,
+	const float *pfViewMatrices, int numViews, int iWidth, int iHeight, OverdrawStats *pStats, ThreadPool *pool, int iMaxCount)
+{
+	int numTilesX = (iWidth + SOFTRASTERTILE - 1) / SOFTRASTERTILE;
+	int numTilesY = (iHeight + SOFTRASTERTILE - 1) / SOFTRASTERTILE;
+	int numTiles = numTilesX * numTilesY;
+	parallelFor(pool, 0, numViews, [&](int viewId) {
+		std::vector<RasterTriangle> triangles;
+		setupViewTriangles(pfVertexPositions, iNumVertices, piIndexBuffer, iNumFaces, pfViewMatrices + viewId * 16, iWidth, iHeight, triangles);
+
+		// bin the triangles (in draw order) to the tiles they touch
+		std::vector<std::vector<int> > bins(numTiles);
+		for (int i = 0; i < (int)triangles.size(); i++)
+		{
+			const RasterTriangle &t = triangles[i];
+			for (int ty = t.bbox[1] / SOFTRASTERTILE; ty <= (t.bbox[3] - 1) / SOFTRASTERTILE; ty++)
+				for (int tx = t.bbox[0] / SOFTRASTERTILE; tx <= (t.bbox[2] - 1) / SOFTRASTERTILE; tx++)
+					bins[ty * numTilesX + tx].push_back(i);
+		}
+
+		std::vector<int> drawn(numTiles, 0), shown(numTiles, 0);
+		parallelFor(pool, 0, numTiles, [&](int tileId) {
+			float pfDepth[SOFTRASTERTILE * SOFTRASTERTILE];
+			int piCount[SOFTRASTERTILE * SOFTRASTERTILE];
+			for (int i = 0; i < SOFTRASTERTILE * SOFTRASTERTILE; i++)
+			{
+				pfDepth[i] = 1.f;
+				piCount[i] = 0;
+			}
+			OverdrawTile tile;
+			tile.x0 = (tileId % numTilesX) * SOFTRASTERTILE;
+			tile.y0 = (tileId / numTilesX) * SOFTRASTERTILE;
+			tile.iWidth = SOFTRASTERTILE;
+			tile.pfDepth = pfDepth;
+			tile.piCount = piCount;
+			const std::vector<int> &bin = bins[tileId];
+			for (size_t i = 0; i < bin.size(); i++)
+				rasterizeTriangle(triangles[bin[i]], tile.x0, tile.y0, tile.x0 + SOFTRASTERTILE, tile.y0 + SOFTRASTERTILE, tile);
+			for (int i = 0; i < SOFTRASTERTILE * SOFTRASTERTILE; i++)
+			{
+				drawn[tileId] += iMaxCount > 0 && piCount[i] > iMaxCount ? iMaxCount : piCount[i];
+				shown[tileId] += piCount[i] > 0;
+			}
+		});
+
+		OverdrawStats &stats = pStats[viewId];
+		stats.drawnPixels = 0;
+		stats.shownPixels = 0;
+		for (int i = 0; i < numTiles; i++)
+		{
+			stats.drawnPixels += drawn[i];
+			stats.shownPixels += shown[i];
+		}
+		stats.ratio = stats.shownPixels > 0 ? (float)stats.drawnPixels / stats.shownPixels : 0.f;
+	});
+}
+
+void printOverdrawReport(const char *const *names, const int *const *piIndexBuffers, int numBuffers, int iNumFaces,
+	float **pfFramesVertexPositions, int numFrames, int iNumVertices, const float *pfCameraPositions, int numViews,
+	int iWidth, int iHeight, ThreadPool *pool)
+{
+	if (numViews <= 0 || numFrames <= 0)
+		return;
+	std::vector<float> viewMatrices(numViews * 16);
+	buildViewMatrices(pfCameraPositions, numViews, (float)iWidth / iHeight, &viewMatrices[0]);
+	std::vector<OverdrawStats> stats(numViews);
+	std::vector<double> viewRatios(numViews);
+	jobPrintf("%-14s %9s %9s %9s\n", "ordering", "overdraw", "best", "worst");
+	for (int b = 0; b < numBuffers; b++)
+	{
+		std::fill(viewRatios.begin(), viewRatios.end(), 0.0);
+		for (int frameId = 0; frameId < numFrames; frameId++)
+		{
+			softwareOverdraw(pfFramesVertexPositions[frameId], iNumVertices, piIndexBuffers[b], iNumFaces, &viewMatrices[0], numViews, iWidth, iHeight, &stats[0], pool);
+			for (int viewId = 0; viewId < numViews; viewId++)
+				viewRatios[viewId] += stats[viewId].ratio / numFrames;
+		}
+		double sum = 0.0;
+		for (int viewId = 0; viewId < numViews; viewId++)
+			sum += viewRatios[viewId];
+		jobPrintf("%-14s %9.4f %9.4f %9.4f\n", names[b], numViews > 0 ? sum / numViews : 0.0,
+			*std::min_element(viewRatios.begin(), viewRatios.end()), *std::max_element(viewRatios.begin(), viewRatios.end()));
+	}
+}
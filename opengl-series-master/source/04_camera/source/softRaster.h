@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+class ThreadPool;
+
+// CPU replacement for Render/overdrawRatio: every view is rasterized into its own iWidth x iHeight canvas with
+// the GL state AppMain uses (depth test GL_LESS, back faces culled, counter-clockwise front faces), and the
+// fragments that pass the depth test in draw order are counted. Each view is cut into SOFTRASTERTILE square
+// tiles that are rasterized independently; views and tiles are spread over the pool.
+#define SOFTRASTERTILE 32
+
+// drawn: fragments that passed the depth test, shown: pixels covered at least once
+struct OverdrawStats
+{
+	int drawnPixels;
+	int shownPixels;
+	float ratio;  // drawn / shown, 0 for an empty view
+};
+
+// a triangle after culling and near plane clipping: window coordinates (pixels, y up, pixel centers at .5),
+// NDC depth, counter-clockwise, with the index of the face it came from
+struct RasterTriangle
+{
+	float x[3];
+	float y[3];
+	float z[3];
+	int face;
+	int bbox[4];  // covered pixels [bbox[0], bbox[2]) x [bbox[1], bbox[3]), clamped to the canvas
+};
+
+// projection * view of every viewpoint, the camera LoadTriangle uses (fov 40, near 1, far 2000, looking at the
+// origin); 16 floats per view, column major
+void buildViewMatrices(const float *pfCameraPositions, int numViews, float fAspect, float *pfViewMatrices);
+
+// transforms, clips and culls the faces for one view, in draw order; a face cut by the near plane can give 2 triangles
+void setupViewTriangles(const float *pfVertexPositions, int iNumVertices, const int *piIndexBuffer, int iNumFaces,
+	const float *pfViewMatrix, int iWidth, int iHeight, std::vector<RasterTriangle> &triangles);
+
+// per view overdraw of an index buffer, pStats holds numViews entries; with iMaxCount > 0 the fragments of one pixel
+// are counted up to iMaxCount, like the 8 bit GL canvas that saturates after 5
+void softwareOverdraw(const float *pfVertexPositions, int iNumVertices, const int *piIndexBuffer, int iNumFaces,
+	const float *pfViewMatrices, int numViews, int iWidth, int iHeight, OverdrawStats *pStats, ThreadPool *pool, int iMaxCount = 0);
+
+// prints the overdraw of each index buffer averaged over the frames and views, with the best and worst view
+void printOverdrawReport(const char *const *names, const int *const *piIndexBuffers, int numBuffers, int iNumFaces,
+	float **pfFramesVertexPositions, int numFrames, int iNumVertices, const float *pfCameraPositions, int numViews,
+	int iWidth, int iHeight, ThreadPool *pool);
+
+// calls fragment(x, y, z) for every pixel of [x0, x1) x [y0, y1) whose center t covers, with the top-left fill rule
+template <class FragmentFn>
+inline void rasterizeTriangle(const RasterTriangle &t, int x0, int y0, int x1, int y1, FragmentFn &fragment)
+{
+	if (x0 < t.bbox[0]) x0 = t.bbox[0];
+	if (y0 < t.bbox[1]) y0 = t.bbox[1];
+	if (x1 > t.bbox[2]) x1 = t.bbox[2];
+	if (y1 > t.bbox[3]) y1 = t.bbox[3];
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	// edge i is opposite vertex i; E_i(p) > 0 inside, edges on the left or top also own the pixels right on them
+	float a[3], b[3], c[3];
+	bool owns[3];
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3, k = (i + 2) % 3;
+		float dx = t.x[k] - t.x[j], dy = t.y[k] - t.y[j];
+		a[i] = -dy;
+		b[i] = dx;
+		c[i] = dy * t.x[j] - dx * t.y[j];
+		owns[i] = dy < 0.f || (dy == 0.f && dx < 0.f);
+	}
+	float area = c[0] + c[1] + c[2];
+	// depth plane z = zx * px + zy * py + z0 from the barycentrics
+	float inv = 1.f / area;
+	float zx = (a[0] * t.z[0] + a[1] * t.z[1] + a[2] * t.z[2]) * inv;
+	float zy = (b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2]) * inv;
+	float z0 = (c[0] * t.z[0] + c[1] * t.z[1] + c[2] * t.z[2]) * inv;
+
+	for (int y = y0; y < y1; y++)
+	{
+		float py = y + 0.5f;
+		for (int x = x0; x < x1; x++)
+		{
+			float px = x + 0.5f;
+			bool inside = true;
+			for (int i = 0; i < 3 && inside; i++)
+			{
+				float e = a[i] * px + b[i] * py + c[i];
+				inside = e > 0.f || (e == 0.f && owns[i]);
+			}
+			if (!inside)
+				continue;
+			float z = zx * px + zy * py + z0;
+			if (z >= -1.f && z <= 1.f)
+				fragment(x, y, z);
+		}
+	}
+}
@@ -0,0 +1,289 @@
+#include "textLoader.h"
+#include "jobLog.h"
+#include "threadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTLOADER_SSE2
+#endif
+
+#define MINCHUNKSIZE (256 * 1024)
+
+static const double pow10Table[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool isDigit(char c)
+{
+	return (unsigned)(c - '0') < 10u;
+}
+
+// reads the whole file with one fread; the buffer is 0 terminated and must be freed by the caller
+static char * readWholeFile(const char *path, size_t &iSize)
+{
+	FILE * myFile = fopen(path, "rb");
+	if (myFile == NULL)
+	{
+		jobPrintf("ERROR: File cannot be opened %s\n", path);
+		return NULL;
+	}
+	fseek(myFile, 0, SEEK_END);
+	long iLength = ftell(myFile);
+	fseek(myFile, 0, SEEK_SET);
+	char *pBuffer = iLength >= 0 ? (char *)malloc(iLength + 1) : NULL;
+	if (pBuffer == NULL || fread(pBuffer, 1, iLength, myFile) != (size_t)iLength)
+	{
+		jobPrintf("ERROR: File cannot be read %s\n", path);
+		free(pBuffer);
+		fclose(myFile);
+		return NULL;
+	}
+	fclose(myFile);
+	pBuffer[iLength] = '\0';
+	iSize = (size_t)iLength;
+	return pBuffer;
+}
+
+// number of whitespace separated tokens in [p, end); p must be at a token boundary
+static int countTokens(const char *p, const char *end)
+{
+	int count = 0;
+	unsigned int prevNonSpace = 0;
+#ifdef TEXTLOADER_SSE2
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i ret = _mm_set1_epi8('\r');
+	const __m128i tab = _mm_set1_epi8('\t');
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)p);
+		__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, newline)),
+			_mm_or_si128(_mm_cmpeq_epi8(c, ret), _mm_cmpeq_epi8(c, tab)));
+		unsigned int nonSpace = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+		// a token starts at every non space byte whose predecessor is a space
+		unsigned int starts = nonSpace & ~((nonSpace << 1) | prevNonSpace);
+		prevNonSpace = nonSpace >> 15;
+		while (starts)
+		{
+			starts &= starts - 1;
+			count++;
+		}
+	}
+#endif
+	for (; p < end; p++)
+	{
+		unsigned int nonSpace = isSpace(*p) ? 0 : 1;
+		count += nonSpace & ~prevNonSpace;
+		prevNonSpace = nonSpace;
+	}
+	return count;
+}
+
+static const char * parseValue(const char *p, int *piOut)
+{
+	bool neg = (*p == '-');
+	if (*p == '-' || *p == '+')
+		p++;
+	if (!isDigit(*p))
+		return NULL;
+	int v = 0;
+	while (isDigit(*p))
+		v = v * 10 + (*p++ - '0');
+	*piOut = neg ? -v : v;
+	return isSpace(*p) || *p == '\0' ? p : NULL;
+}
+
+// fast path for the plain decimals written by the exporter, strtod for anything unusual
+static const char * parseValue(const char *p, float *pfOut)
+{
+	const char *s = p;
+	bool neg = (*p == '-');
+	if (*p == '-' || *p == '+')
+		p++;
+	unsigned long long m = 0;
+	// digits counts the significant ones, leading zeros only shift the exponent
+	int digits = 0, exp10 = 0;
+	bool sawDigit = false;
+	while (isDigit(*p))
+	{
+		sawDigit = true;
+		if (digits == 0 && *p == '0') {}
+		else if (digits < 19) { m = m * 10 + (*p - '0'); digits++; }
+		else exp10++;
+		p++;
+	}
+	if (*p == '.')
+	{
+		p++;
+		while (isDigit(*p))
+		{
+			sawDigit = true;
+			if (digits == 0 && *p == '0') exp10--;
+			else if (digits < 19) { m = m * 10 + (*p - '0'); digits++; exp10--; }
+			p++;
+		}
+	}
+	// a bare "." (or sign) has no digit and is left to strtod, which rejects it
+	bool fast = sawDigit && *p != 'e' && *p != 'E' && exp10 >= -22 && exp10 <= 22;
+	if (fast)
+	{
+		double v = (double)m;
+		v = exp10 < 0 ? v / pow10Table[-exp10] : v * pow10Table[exp10];
+		*pfOut = (float)(neg ? -v : v);
+	}
+	else
+	{
+		char *pEnd;
+		*pfOut = (float)strtod(s, &pEnd);
+		if (pEnd == s)
+			return NULL;
+		p = pEnd;
+	}
+	return isSpace(*p) || *p == '\0' ? p : NULL;
+}
+
+// parses the tokens in [p, end) into pValues; returns the number of values, -1 on a malformed token
+// and maxValues + 1 if there are more than maxValues tokens
+template <typename T>
+static int parseChunk(const char *p, const char *end, T *pValues, int maxValues)
+{
+	T *pOut = pValues;
+	for (;;)
+	{
+		while (p < end && isSpace(*p))
+			p++;
+		if (p >= end)
+			break;
+		if (pOut - pValues == maxValues)
+			return maxValues + 1;
+		p = parseValue(p, pOut++);
+		if (p == NULL)
+			return -1;
+	}
+	return (int)(pOut - pValues);
+}
+
+template <typename T>
+static bool loadTextValues(const char *path, T *pValues, int numValues, ThreadPool *pool)
+{
+	size_t iSize;
+	char *pBuffer = readWholeFile(path, iSize);
+	if (pBuffer == NULL)
+		return false;
+
+	// chunk boundaries sit just after a newline so no value is split
+	int numChunks = 1;
+	if (pool != NULL && iSize >= 2 * MINCHUNKSIZE)
+	{
+		numChunks = (int)(iSize / MINCHUNKSIZE);
+		if (numChunks > pool->size() * 4)
+			numChunks = pool->size() * 4;
+	}
+	std::vector<const char *> chunkStart(numChunks + 1);
+	chunkStart[0] = pBuffer;
+	chunkStart[numChunks] = pBuffer + iSize;
+	for (int k = 1; k < numChunks; k++)
+	{
+		const char *p = pBuffer + iSize / numChunks * k;
+		if (p < chunkStart[k - 1])
+			p = chunkStart[k - 1];
+		const char *nl = (const char *)memchr(p, '\n', pBuffer + iSize - p);
+		chunkStart[k] = nl != NULL ? nl + 1 : pBuffer + iSize;
+	}
+
+	bool ok = true;
+	if (numChunks == 1)
+	{
+		int n = parseChunk(chunkStart[0], chunkStart[1], pValues, numValues);
+		if (n < 0)
+		{
+			ok = false;
+			jobPrintf("ERROR: %s contains a malformed value\n", path);
+		}
+		else if (n != numValues)
+		{
+			ok = false;
+			jobPrintf("ERROR: %s has %s%d values, expected %d\n", path, n > numValues ? "more than " : "", n > numValues ? numValues : n, numValues);
+		}
+	}
+	else
+	{
+		// count the values of every chunk first so each chunk knows where its output starts
+		std::vector<int> chunkOffset(numChunks + 1, 0);
+		parallelFor(pool, 0, numChunks, [&](int k) {
+			chunkOffset[k + 1] = countTokens(chunkStart[k], chunkStart[k + 1]);
+		});
+		for (int k = 0; k < numChunks; k++)
+			chunkOffset[k + 1] += chunkOffset[k];
+		if (chunkOffset[numChunks] != numValues)
+		{
+			jobPrintf("ERROR: %s has %d values, expected %d\n", path, chunkOffset[numChunks], numValues);
+			free(pBuffer);
+			return false;
+		}
+		std::vector<int> chunkParsed(numChunks);
+		parallelFor(pool, 0, numChunks, [&](int k) {
+			chunkParsed[k] = parseChunk(chunkStart[k], chunkStart[k + 1], pValues + chunkOffset[k], chunkOffset[k + 1] - chunkOffset[k]);
+		});
+		for (int k = 0; k < numChunks; k++)
+		{
+			if (chunkParsed[k] != chunkOffset[k + 1] - chunkOffset[k])
+			{
+				jobPrintf("ERROR: %s contains a malformed value\n", path);
+				ok = false;
+				break;
+			}
+		}
+	}
+	free(pBuffer);
+	return ok;
+}
+
+bool loadTextFloats(const char *path, float *pfValues, int numValues, ThreadPool *pool)
+{
+	return loadTextValues(path, pfValues, numValues, pool);
+}
+
+bool loadTextInts(const char *path, int *piValues, int numValues, ThreadPool *pool)
+{
+	return loadTextValues(path, piValues, numValues, pool);
+}
+
+int countTextValues(const char *path)
+{
+	size_t iSize;
+	char *pBuffer = readWholeFile(path, iSize);
+	if (pBuffer == NULL)
+		return -1;
+	int count = countTokens(pBuffer, pBuffer + iSize);
+	free(pBuffer);
+	return count;
+}
+
+bool loadTextFrames(const char *vfFolder, int firstFrame, int numFrames, float **pfFramesVertexPositions, int iNumVertices, ThreadPool *pool)
+{
+	std::vector<char> frameOk(numFrames, 0);
+	parallelFor(pool, 0, numFrames, [&](int i) {
+		char verticesPath[300];
+		sprintf(verticesPath, "%sframe%dv.txt", vfFolder, firstFrame + i + 1);
+		// frames are already spread over the pool, so every file is parsed on its own thread
+		frameOk[i] = loadTextFloats(verticesPath, pfFramesVertexPositions[i], iNumVertices * 3, NULL);
+	});
+	for (int i = 0; i < numFrames; i++)
+	{
+		if (!frameOk[i])
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+class ThreadPool;
+
+// parallel loaders for the VerticeFace text files (whitespace separated values, usually one per line)
+// each file is read with one fread, cut into chunks on line boundaries and the chunks are parsed on the pool;
+// pool may be NULL to parse on the calling thread. numValues must match the file exactly.
+bool loadTextFloats(const char *path, float *pfValues, int numValues, ThreadPool *pool);
+bool loadTextInts(const char *path, int *piValues, int numValues, ThreadPool *pool);
+
+// counts the values in a text file without converting them, -1 if it cannot be read
+int countTextValues(const char *path);
+
+// loads frame<firstFrame+1>v.txt .. frame<firstFrame+numFrames>v.txt of vfFolder, one frame per task
+bool loadTextFrames(const char *vfFolder, int firstFrame, int numFrames, float **pfFramesVertexPositions, int iNumVertices, ThreadPool *pool);
@@ -0,0 +1,114 @@
+#include "threadPool.h"
+
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int numThreads) :
+	numPending(0),
+	stopping(false)
+{
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskReady.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::submit(const std::function<void()> &task)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		tasks.push_back(task);
+		numPending++;
+	}
+	taskReady.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (numPending > 0)
+		allDone.wait(lock);
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && tasks.empty())
+				taskReady.wait(lock);
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (--numPending == 0)
+				allDone.notify_all();
+		}
+	}
+}
+
+// shared between the caller of parallelFor and its helper tasks; helpers that only get
+// to run after the range is exhausted return without touching the body
+struct ParallelForState
+{
+	std::atomic<int> next;
+	int end;
+	std::function<void(int)> body;
+	std::mutex mutex;
+	std::condition_variable finished;
+	int numRunning;
+};
+
+static void runParallelFor(const std::shared_ptr<ParallelForState> &state)
+{
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		if (state->next.load() >= state->end)
+			return;
+		state->numRunning++;
+	}
+	for (int i = state->next++; i < state->end; i = state->next++)
+		state->body(i);
+	std::unique_lock<std::mutex> lock(state->mutex);
+	if (--state->numRunning == 0)
+		state->finished.notify_all();
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)> &body)
+{
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->next = begin;
+	state->end = end;
+	state->body = body;
+	state->numRunning = 0;
+
+	int numHelpers = end - begin - 1;
+	if (numHelpers > size())
+		numHelpers = size();
+	for (int i = 0; i < numHelpers; i++)
+		submit([state]() { runParallelFor(state); });
+
+	runParallelFor(state);
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while (state->numRunning > 0)
+		state->finished.wait(lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed size pool of worker threads fed from one task queue
+class ThreadPool
+{
+public:
+	// numThreads <= 0 uses one thread per hardware thread
+	explicit ThreadPool(int numThreads = 0);
+	~ThreadPool();
+
+	int size() const { return (int)workers.size(); }
+
+	void submit(const std::function<void()> &task);
+
+	// blocks until every task submitted so far has finished
+	void wait();
+
+	// runs body(i) for every i in [begin, end) and returns when all calls are done;
+	// the calling thread takes part, so it is safe to call from inside a pool task
+	void parallelFor(int begin, int end, const std::function<void(int)> &body);
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable taskReady;
+	std::condition_variable allDone;
+	int numPending;
+	bool stopping;
+};
+
+// parallelFor that falls back to a plain loop when there is no pool
+inline void parallelFor(ThreadPool *pool, int begin, int end, const std::function<void(int)> &body)
+{
+	if (pool != NULL && pool->size() > 1 && end - begin > 1)
+	{
+		pool->parallelFor(begin, end, body);
+	}
+	else
+	{
+		for (int i = begin; i < end; i++)
+			body(i);
+	}
+}
@@ -0,0 +1,216 @@
+#include "vcacheSim.h"
+#include "jobLog.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+int VCacheSimScratchSize(int model, int iNumVertices)
+{
+	return model == VCACHE_LRU ? iNumVertices * 3 : iNumVertices;
+}
+
+void initVCacheSim(VCacheSim *sim, int model, int iCacheSize, int iNumVertices, int *piScratch)
+{
+	memset(sim, 0, sizeof(VCacheSim));
+	sim->model = model;
+	sim->iCacheSize = iCacheSize;
+	sim->iNumVertices = iNumVertices;
+	sim->piStamp = piScratch;
+	memset(piScratch, 0, VCacheSimScratchSize(model, iNumVertices) * sizeof(int));
+	if (model == VCACHE_LRU)
+	{
+		sim->piPrev = piScratch + iNumVertices;
+		sim->piNext = sim->piPrev + iNumVertices;
+	}
+	sim->iHead = sim->iTail = -1;
+	sim->iClock = model == VCACHE_FIFO ? iCacheSize + 1 : 1; //so that a stamp of 0 is out of cache
+}
+
+void finishVCacheSim(VCacheSim *sim)
+{
+	memset(sim->piStamp, 0, VCacheSimScratchSize(sim->model, sim->iNumVertices) * sizeof(int));
+}
+
+void flushVCacheSim(VCacheSim *sim)
+{
+	if (sim->model == VCACHE_FIFO)
+	{
+		sim->iClock += sim->iCacheSize;
+	}
+	else if (sim->model == VCACHE_BATCH)
+	{
+		sim->iClock++;
+		sim->iCount = 0;
+	}
+	else
+	{
+		for (int v = sim->iHead; v != -1; v = sim->piNext[v])
+			sim->piStamp[v] = 0;
+		sim->iHead = sim->iTail = -1;
+		sim->iCount = 0;
+	}
+}
+
+static void lruUnlink(VCacheSim *sim, int v)
+{
+	int prev = sim->piPrev[v], next = sim->piNext[v];
+	if (prev != -1)
+		sim->piNext[prev] = next;
+	else
+		sim->iHead = next;
+	if (next != -1)
+		sim->piPrev[next] = prev;
+	else
+		sim->iTail = prev;
+}
+
+static void lruPushFront(VCacheSim *sim, int v)
+{
+	sim->piPrev[v] = -1;
+	sim->piNext[v] = sim->iHead;
+	if (sim->iHead != -1)
+		sim->piPrev[sim->iHead] = v;
+	else
+		sim->iTail = v;
+	sim->iHead = v;
+}
+
+bool accessVCacheSim(VCacheSim *sim, int vertexId)
+{
+	int *piStamp = sim->piStamp;
+	if (sim->model == VCACHE_FIFO)
+	{
+		if (sim->iClock - piStamp[vertexId] <= sim->iCacheSize)
+			return true;
+		piStamp[vertexId] = sim->iClock++;
+	}
+	else if (sim->model == VCACHE_BATCH)
+	{
+		if (piStamp[vertexId] == sim->iClock)
+			return true;
+		if (sim->iCount == sim->iCacheSize)
+		{
+			sim->iClock++;
+			sim->iCount = 0;
+		}
+		piStamp[vertexId] = sim->iClock;
+		sim->iCount++;
+	}
+	else
+	{
+		if (piStamp[vertexId])
+		{
+			if (sim->iHead != vertexId)
+			{
+				lruUnlink(sim, vertexId);
+				lruPushFront(sim, vertexId);
+			}
+			return true;
+		}
+		piStamp[vertexId] = 1;
+		lruPushFront(sim, vertexId);
+		if (++sim->iCount > sim->iCacheSize)
+		{
+			int evicted = sim->iTail;
+			lruUnlink(sim, evicted);
+			piStamp[evicted] = 0;
+			sim->iCount--;
+		}
+	}
+	sim->iNumMisses++;
+	return false;
+}
+
+int accessVCacheFace(VCacheSim *sim, const int *piFace)
+{
+	if (sim->model == VCACHE_BATCH)
+	{
+		// distinct vertices of the triangle that the current batch does not have yet
+		int n = 0;
+		for (int m = 0; m < 3; m++)
+		{
+			if (sim->piStamp[piFace[m]] != sim->iClock && (m == 0 || piFace[m] != piFace[0]) && (m < 2 || piFace[2] != piFace[1]))
+				n++;
+		}
+		if (sim->iCount + n > sim->iCacheSize)
+			flushVCacheSim(sim);
+	}
+	int iMisses = 0;
+	for (int m = 0; m < 3; m++)
+	{
+		if (!accessVCacheSim(sim, piFace[m]))
+			iMisses++;
+	}
+	sim->iNumFaces++;
+	return iMisses;
+}
+
+int simulateVCacheRange(VCacheSim *sim, const int *piIndexBuffer, int iFirstFace, int iNumFaces)
+{
+	int iMisses = 0;
+	const int *p = piIndexBuffer + iFirstFace * 3;
+	for (int k = 0; k < iNumFaces; k++, p += 3)
+		iMisses += accessVCacheFace(sim, p);
+	return iMisses;
+}
+
+void simulateVCache(int model, int iCacheSize, const int *piIndexBuffer, int iNumFaces, int iNumVertices, VCacheStats *stats, int *piScratch)
+{
+	bool bMalloc = false;
+	if (piScratch == NULL)
+	{
+		piScratch = (int *)malloc(VCacheSimScratchSize(model, iNumVertices) * sizeof(int));
+		bMalloc = true;
+	}
+	VCacheSim sim;
+	initVCacheSim(&sim, model, iCacheSize, iNumVertices, piScratch);
+	simulateVCacheRange(&sim, piIndexBuffer, 0, iNumFaces);
+	finishVCacheSim(&sim);
+	if (bMalloc)
+	{
+		free(piScratch);
+	}
+
+	std::vector<char> referenced(iNumVertices, 0);
+	int iNumReferenced = 0;
+	for (int i = 0; i < iNumFaces * 3; i++)
+	{
+		if (!referenced[piIndexBuffer[i]])
+		{
+			referenced[piIndexBuffer[i]] = 1;
+			iNumReferenced++;
+		}
+	}
+	stats->iNumFaces = sim.iNumFaces;
+	stats->iNumMisses = sim.iNumMisses;
+	stats->acmr = iNumFaces > 0 ? sim.iNumMisses / (float)iNumFaces : 0.f;
+	stats->atvr = iNumReferenced > 0 ? sim.iNumMisses / (float)iNumReferenced : 0.f;
+}
+
+void printVCacheReport(const char *const *names, const int *const *piIndexBuffers, int numBuffers, int iNumFaces, int iNumVertices)
+{
+	static const char *modelNames[3] = { "fifo", "lru", "batch" };
+	static const int cacheSizes[] = { 8, 12, 16, 20, 24, 32, 64 };
+	int *piScratch = (int *)malloc(VCacheSimScratchSize(VCACHE_LRU, iNumVertices) * sizeof(int));
+	jobPrintf("%-6s %5s", "model", "size");
+	for (int b = 0; b < numBuffers; b++)
+		jobPrintf("  %14s acmr/atvr", names[b]);
+	jobPrintf("\n");
+	for (int model = VCACHE_FIFO; model <= VCACHE_BATCH; model++)
+	{
+		for (size_t s = 0; s < sizeof(cacheSizes) / sizeof(cacheSizes[0]); s++)
+		{
+			jobPrintf("%-6s %5d", modelNames[model], cacheSizes[s]);
+			for (int b = 0; b < numBuffers; b++)
+			{
+				VCacheStats stats;
+				simulateVCache(model, cacheSizes[s], piIndexBuffers[b], iNumFaces, iNumVertices, &stats, piScratch);
+				jobPrintf("  %14.3f / %7.3f", stats.acmr, stats.atvr);
+			}
+			jobPrintf("\n");
+		}
+	}
+	free(piScratch);
+}
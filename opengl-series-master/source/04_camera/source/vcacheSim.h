@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+
+// post-transform vertex cache simulation with O(1) hit tests:
+//   VCACHE_FIFO   a vertex is in the cache if fewer than iCacheSize misses happened since it was inserted
+//                 (per vertex insertion stamps, the model FanVertLinSort and OverdrawOrderPartition assume)
+//   VCACHE_LRU    least recently used, kept as a doubly linked list threaded through per vertex arrays
+//   VCACHE_BATCH  batch based GPUs: vertices are shaded per batch of at most iCacheSize distinct vertices,
+//                 a hit only happens inside the current batch (per vertex batch stamps)
+enum VCacheModel
+{
+	VCACHE_FIFO,
+	VCACHE_LRU,
+	VCACHE_BATCH
+};
+
+struct VCacheSim
+{
+	int model;
+	int iCacheSize;
+	int iNumVertices;
+	int *piStamp;      // FIFO: insertion time, BATCH: batch id, LRU: 1 if cached
+	int *piPrev;       // LRU only, most recent at iHead
+	int *piNext;
+	int iClock;        // FIFO: misses so far + iCacheSize + 1, BATCH: current batch id
+	int iHead;
+	int iTail;
+	int iCount;        // LRU entries / BATCH vertices in the current batch
+	long long iNumFaces;
+	long long iNumMisses;
+};
+
+struct VCacheStats
+{
+	long long iNumFaces;
+	long long iNumMisses;
+	float acmr;  // misses per triangle
+	float atvr;  // misses per vertex referenced
+};
+
+// ints of scratch initVCacheSim needs
+int VCacheSimScratchSize(int model, int iNumVertices);
+
+// piScratch holds VCacheSimScratchSize ints and belongs to the simulator until it is dropped;
+// it is left zeroed when finishVCacheSim is called
+void initVCacheSim(VCacheSim *sim, int model, int iCacheSize, int iNumVertices, int *piScratch);
+void finishVCacheSim(VCacheSim *sim);
+
+// empties the cache without touching the counters
+void flushVCacheSim(VCacheSim *sim);
+
+// returns true on a hit, a miss inserts the vertex
+bool accessVCacheSim(VCacheSim *sim, int vertexId);
+
+// the 3 vertices of a triangle, returns the misses; a batch is closed before a triangle that does not fit
+int accessVCacheFace(VCacheSim *sim, const int *piFace);
+
+// simulates faces [iFirstFace, iFirstFace + iNumFaces) of piIndexBuffer and returns their misses
+int simulateVCacheRange(VCacheSim *sim, const int *piIndexBuffer, int iFirstFace, int iNumFaces);
+
+// runs a whole index buffer through a cold cache; piScratch may be NULL
+void simulateVCache(int model, int iCacheSize, const int *piIndexBuffer, int iNumFaces, int iNumVertices, VCacheStats *stats, int *piScratch = NULL);
+
+// prints ACMR/ATVR of each index buffer for every model and a range of cache sizes
+void printVCacheReport(const char *const *names, const int *const *piIndexBuffers, int numBuffers, int iNumFaces, int iNumVertices);